@@ -0,0 +1,424 @@
+// Сравнение механизмов IPC, которые используются в лабораторных:
+//   pipe      — каналы, как в lab1;
+//   mutex     — потоки и pthread-мьютекс с условной переменной, как в lab2;
+//   shm_sem   — разделяемая память и пара семафоров на один слот, как было в lab3;
+//   shm_ring  — разделяемая память и кольцевые буферы SpscRing из lab3;
+//   zmq_tcp   — сокеты ZeroMQ DEALER поверх TCP, как в lab5_7 (если найден libzmq).
+// Для каждого механизма и размера сообщения измеряется задержка в одну сторону
+// (отправитель ждёт подтверждения перед следующим сообщением) и пропускная
+// способность потока без подтверждений. Отправитель кладёт в начало сообщения
+// время CLOCK_MONOTONIC, получатель вычитает его из своего — часы общие для всех процессов.
+// Результат печатается в stdout в формате JSON.
+// Запуск: ./ipc_bench [сообщений на замер] [механизм...]
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <semaphore.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hdr_histogram.h"
+#include "spsc_ring.h"
+#ifdef HAVE_ZMQ
+#include "zmq.h"
+#endif
+
+const size_t MAX_MESSAGE = 4096;
+
+// Размеры сообщений: int из lab1, message из lab5_7, SharedData из lab3 и два крупных
+struct MessageSize {
+    const char* format;
+    size_t size;
+};
+
+const MessageSize MESSAGE_SIZES[] = {
+    {"lab1_int", 16}, {"lab5_7_message", 48}, {"lab3_shared_data", 264}, {"1k", 1024}, {"4k", 4096},
+};
+
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void* map_shared(size_t size) {
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        std::cerr << "Ошибка при отображении разделяемой памяти" << std::endl;
+        exit(1);
+    }
+    return mem;
+}
+
+// Канал от отправителя к получателю и обратный канал подтверждений.
+// Отправитель работает в дочернем процессе (или во втором потоке, если in_process()).
+class Link {
+public:
+    virtual ~Link() {}
+    virtual bool in_process() const { return false; }
+    // Вызываются уже в своём процессе, после fork
+    virtual void sender_setup() {}
+    virtual void receiver_setup() {}
+    virtual void send(const char* data, size_t size) = 0;
+    virtual void receive(char* data, size_t size) = 0;
+    virtual void ack() = 0;
+    virtual void wait_ack() = 0;
+};
+
+class PipeLink : public Link {
+public:
+    PipeLink() {
+        if (pipe(data_) < 0 || pipe(acks_) < 0) {
+            std::cerr << "Ошибка при создании pipe" << std::endl;
+            exit(1);
+        }
+    }
+    ~PipeLink() {
+        for (int fd : {data_[0], data_[1], acks_[0], acks_[1]})
+            close(fd);
+    }
+    void send(const char* data, size_t size) override { write_all(data_[1], data, size); }
+    void receive(char* data, size_t size) override { read_all(data_[0], data, size); }
+    void ack() override {
+        char byte = 0;
+        write_all(acks_[1], &byte, 1);
+    }
+    void wait_ack() override {
+        char byte;
+        read_all(acks_[0], &byte, 1);
+    }
+
+private:
+    static void write_all(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = write(fd, data, size);
+            if (n <= 0) exit(1);
+            data += n;
+            size -= n;
+        }
+    }
+    static void read_all(int fd, char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = read(fd, data, size);
+            if (n <= 0) exit(1);
+            data += n;
+            size -= n;
+        }
+    }
+    int data_[2], acks_[2];
+};
+
+// Очередь сообщений под мьютексом, потоки одного процесса
+class MutexLink : public Link {
+public:
+    static const size_t CAPACITY = 256;
+
+    MutexLink() : buffer_(CAPACITY * MAX_MESSAGE) {
+        pthread_mutex_init(&mutex_, nullptr);
+        pthread_cond_init(&changed_, nullptr);
+    }
+    ~MutexLink() {
+        pthread_cond_destroy(&changed_);
+        pthread_mutex_destroy(&mutex_);
+    }
+    bool in_process() const override { return true; }
+    void send(const char* data, size_t size) override {
+        pthread_mutex_lock(&mutex_);
+        while (tail_ - head_ == CAPACITY)
+            pthread_cond_wait(&changed_, &mutex_);
+        memcpy(&buffer_[(tail_ % CAPACITY) * MAX_MESSAGE], data, size);
+        ++tail_;
+        pthread_cond_broadcast(&changed_);
+        pthread_mutex_unlock(&mutex_);
+    }
+    void receive(char* data, size_t size) override {
+        pthread_mutex_lock(&mutex_);
+        while (tail_ == head_)
+            pthread_cond_wait(&changed_, &mutex_);
+        memcpy(data, &buffer_[(head_ % CAPACITY) * MAX_MESSAGE], size);
+        ++head_;
+        pthread_cond_broadcast(&changed_);
+        pthread_mutex_unlock(&mutex_);
+    }
+    void ack() override {
+        pthread_mutex_lock(&mutex_);
+        ++acks_;
+        pthread_cond_broadcast(&changed_);
+        pthread_mutex_unlock(&mutex_);
+    }
+    void wait_ack() override {
+        pthread_mutex_lock(&mutex_);
+        while (acks_ == 0)
+            pthread_cond_wait(&changed_, &mutex_);
+        --acks_;
+        pthread_mutex_unlock(&mutex_);
+    }
+
+private:
+    pthread_mutex_t mutex_;
+    pthread_cond_t changed_;
+    std::vector<char> buffer_;
+    size_t head_ = 0, tail_ = 0, acks_ = 0;
+};
+
+// Один слот в разделяемой памяти и семафоры «слот свободен» / «данные готовы»
+class ShmSemLink : public Link {
+public:
+    struct Shared {
+        sem_t slot_free;
+        sem_t data_ready;
+        sem_t ack;
+        char slot[MAX_MESSAGE];
+    };
+
+    ShmSemLink() : shared_((Shared*)map_shared(sizeof(Shared))) {
+        sem_init(&shared_->slot_free, 1, 1);
+        sem_init(&shared_->data_ready, 1, 0);
+        sem_init(&shared_->ack, 1, 0);
+    }
+    ~ShmSemLink() {
+        sem_destroy(&shared_->slot_free);
+        sem_destroy(&shared_->data_ready);
+        sem_destroy(&shared_->ack);
+        munmap(shared_, sizeof(Shared));
+    }
+    void send(const char* data, size_t size) override {
+        sem_wait(&shared_->slot_free);
+        memcpy(shared_->slot, data, size);
+        sem_post(&shared_->data_ready);
+    }
+    void receive(char* data, size_t size) override {
+        sem_wait(&shared_->data_ready);
+        memcpy(data, shared_->slot, size);
+        sem_post(&shared_->slot_free);
+    }
+    void ack() override { sem_post(&shared_->ack); }
+    void wait_ack() override { sem_wait(&shared_->ack); }
+
+private:
+    Shared* shared_;
+};
+
+// Кольцевые буферы lab3; ячейка ровно под размер сообщения
+template <size_t Size>
+class ShmRingLink : public Link {
+public:
+    struct Message {
+        char data[Size];
+    };
+    struct Shared {
+        SpscRing<Message, 1024> data;
+        SpscRing<uint32_t, 64> acks;
+    };
+
+    ShmRingLink() : shared_((Shared*)map_shared(sizeof(Shared))) {}
+    ~ShmRingLink() { munmap(shared_, sizeof(Shared)); }
+    void send(const char* data, size_t size) override {
+        memcpy(message_.data, data, size);
+        shared_->data.push(message_, send_budget_);
+    }
+    void receive(char* data, size_t size) override {
+        shared_->data.pop(message_, recv_budget_);
+        memcpy(data, message_.data, size);
+    }
+    void ack() override { shared_->acks.push(0, ack_budget_); }
+    void wait_ack() override {
+        uint32_t value;
+        shared_->acks.pop(value, ack_budget_);
+    }
+
+private:
+    Shared* shared_;
+    Message message_;
+    SpinBudget send_budget_, recv_budget_, ack_budget_;
+};
+
+#ifdef HAVE_ZMQ
+// Пара DEALER-сокетов, как между узлами lab5_7. Контекст создаётся в каждом процессе
+// после fork; адрес, выбранный получателем, передаётся отправителю через pipe.
+class ZmqLink : public Link {
+public:
+    ZmqLink() {
+        if (pipe(endpoint_pipe_) < 0)
+            exit(1);
+    }
+    ~ZmqLink() {
+        if (socket_) zmq_close(socket_);
+        if (context_) zmq_ctx_term(context_);
+        close(endpoint_pipe_[0]);
+        close(endpoint_pipe_[1]);
+    }
+    void receiver_setup() override {
+        open_socket();
+        zmq_bind(socket_, "tcp://127.0.0.1:*");
+        char endpoint[256] = {};
+        size_t length = sizeof(endpoint);
+        zmq_getsockopt(socket_, ZMQ_LAST_ENDPOINT, endpoint, &length);
+        write(endpoint_pipe_[1], endpoint, sizeof(endpoint));
+    }
+    void sender_setup() override {
+        open_socket();
+        char endpoint[256];
+        if (read(endpoint_pipe_[0], endpoint, sizeof(endpoint)) != sizeof(endpoint))
+            exit(1);
+        zmq_connect(socket_, endpoint);
+    }
+    void send(const char* data, size_t size) override { zmq_send(socket_, data, size, 0); }
+    void receive(char* data, size_t size) override { zmq_recv(socket_, data, size, 0); }
+    void ack() override { zmq_send(socket_, "", 0, 0); }
+    void wait_ack() override {
+        char byte;
+        zmq_recv(socket_, &byte, 1, 0);
+    }
+
+private:
+    void open_socket() {
+        context_ = zmq_ctx_new();
+        socket_ = zmq_socket(context_, ZMQ_DEALER);
+        int linger = 0;
+        zmq_setsockopt(socket_, ZMQ_LINGER, &linger, sizeof(linger));
+    }
+    void* context_ = nullptr;
+    void* socket_ = nullptr;
+    int endpoint_pipe_[2];
+};
+#endif
+
+struct Result {
+    LatencyHistogram latency;
+    double throughput = 0; // сообщений в секунду
+};
+
+// Отправитель: сначала count сообщений с подтверждением каждого, затем поток из
+// count сообщений с одним подтверждением в конце
+void run_sender(Link& link, size_t size, int count) {
+    link.sender_setup();
+    char message[MAX_MESSAGE] = {};
+    for (int i = 0; i < count; ++i) {
+        uint64_t sent = now_ns();
+        memcpy(message, &sent, sizeof(sent));
+        link.send(message, size);
+        link.wait_ack();
+    }
+    for (int i = 0; i < count; ++i) {
+        uint64_t sent = now_ns();
+        memcpy(message, &sent, sizeof(sent));
+        link.send(message, size);
+    }
+    link.wait_ack();
+}
+
+Result run_receiver(Link& link, size_t size, int count) {
+    Result result;
+    char message[MAX_MESSAGE];
+    uint64_t sent;
+    for (int i = 0; i < count; ++i) {
+        link.receive(message, size);
+        uint64_t received = now_ns();
+        memcpy(&sent, message, sizeof(sent));
+        result.latency.record(received - sent);
+        link.ack();
+    }
+    // Поток считается от отправки первого сообщения до приёма последнего
+    uint64_t first_sent = 0;
+    for (int i = 0; i < count; ++i) {
+        link.receive(message, size);
+        if (i == 0)
+            memcpy(&first_sent, message, sizeof(first_sent));
+    }
+    result.throughput = count * 1e9 / (now_ns() - first_sent);
+    link.ack();
+    return result;
+}
+
+Result run_link(Link& link, size_t size, int count) {
+    if (link.in_process()) {
+        std::thread sender([&] { run_sender(link, size, count); });
+        link.receiver_setup();
+        Result result = run_receiver(link, size, count);
+        sender.join();
+        return result;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        run_sender(link, size, count);
+        _exit(0);
+    }
+    link.receiver_setup();
+    Result result = run_receiver(link, size, count);
+    waitpid(pid, nullptr, 0);
+    return result;
+}
+
+template <size_t Size>
+std::unique_ptr<Link> make_ring_link() {
+    return std::make_unique<ShmRingLink<Size>>();
+}
+
+std::unique_ptr<Link> make_link(const std::string& mechanism, size_t size) {
+    if (mechanism == "pipe") return std::make_unique<PipeLink>();
+    if (mechanism == "mutex") return std::make_unique<MutexLink>();
+    if (mechanism == "shm_sem") return std::make_unique<ShmSemLink>();
+    if (mechanism == "shm_ring") {
+        switch (size) {
+        case 16: return make_ring_link<16>();
+        case 48: return make_ring_link<48>();
+        case 264: return make_ring_link<264>();
+        case 1024: return make_ring_link<1024>();
+        default: return make_ring_link<4096>();
+        }
+    }
+#ifdef HAVE_ZMQ
+    if (mechanism == "zmq_tcp") return std::make_unique<ZmqLink>();
+#endif
+    return nullptr;
+}
+
+void print_json(const std::string& mechanism, const MessageSize& size, int count, const Result& result, bool last) {
+    const LatencyHistogram& h = result.latency;
+    std::cout << "    {\"mechanism\": \"" << mechanism << "\", \"format\": \"" << size.format
+              << "\", \"size\": " << size.size << ", \"messages\": " << count
+              << ", \"latency_ns\": {\"min\": " << h.min() << ", \"mean\": " << (uint64_t)h.mean()
+              << ", \"p50\": " << h.percentile(50) << ", \"p99\": " << h.percentile(99)
+              << ", \"p999\": " << h.percentile(99.9) << ", \"max\": " << h.max() << "}"
+              << ", \"throughput_msg_s\": " << (uint64_t)result.throughput
+              << ", \"throughput_mb_s\": " << result.throughput * size.size / 1e6 << "}" << (last ? "" : ",")
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : 20000;
+    if (count <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [messages] [pipe|mutex|shm_sem|shm_ring|zmq_tcp ...]" << std::endl;
+        return 1;
+    }
+    std::vector<std::string> mechanisms(argv + std::min(argc, 2), argv + argc);
+    if (mechanisms.empty()) {
+        mechanisms = {"pipe", "mutex", "shm_sem", "shm_ring"};
+#ifdef HAVE_ZMQ
+        mechanisms.push_back("zmq_tcp");
+#endif
+    }
+    for (const std::string& mechanism : mechanisms) {
+        if (!make_link(mechanism, MESSAGE_SIZES[0].size)) {
+            std::cerr << "Неизвестный механизм: " << mechanism << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "{\"benchmarks\": [" << std::endl;
+    size_t sizes = sizeof(MESSAGE_SIZES) / sizeof(MESSAGE_SIZES[0]);
+    for (size_t m = 0; m < mechanisms.size(); ++m) {
+        for (size_t s = 0; s < sizes; ++s) {
+            std::unique_ptr<Link> link = make_link(mechanisms[m], MESSAGE_SIZES[s].size);
+            Result result = run_link(*link, MESSAGE_SIZES[s].size, count);
+            print_json(mechanisms[m], MESSAGE_SIZES[s], count, result, m + 1 == mechanisms.size() && s + 1 == sizes);
+        }
+    }
+    std::cout << "]}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,91 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Гистограмма задержек в духе HdrHistogram. Значения группируются по степеням
+// двойки, а каждая степень делится на 2^SUB_BITS равных поддиапазонов, поэтому
+// относительная погрешность не больше 1/2^SUB_BITS (< 1%) на всём диапазоне
+// uint64, память фиксирована, а запись значения — O(1) без ветвлений по данным.
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 7;
+    static const uint64_t SUB_COUNT = 1ULL << SUB_BITS;
+
+    LatencyHistogram() : counts_(SUB_COUNT * (64 - SUB_BITS + 1), 0) {}
+
+    void record(uint64_t value) {
+        ++counts_[index_of(value)];
+        ++total_;
+        sum_ += value;
+        if (value < min_) min_ = value;
+        if (value > max_) max_ = value;
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < counts_.size(); ++i)
+            counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        sum_ += other.sum_;
+        if (other.min_ < min_) min_ = other.min_;
+        if (other.max_ > max_) max_ = other.max_;
+    }
+
+    void reset() {
+        counts_.assign(counts_.size(), 0);
+        total_ = sum_ = max_ = 0;
+        min_ = UINT64_MAX;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ ? (double)sum_ / total_ : 0; }
+
+    // Значение, не меньше которого percent процентов записей (верхняя граница поддиапазона)
+    uint64_t percentile(double percent) const {
+        if (total_ == 0)
+            return 0;
+        uint64_t rank = (uint64_t)(percent / 100.0 * total_ + 0.5);
+        if (rank == 0) rank = 1;
+        if (rank > total_) rank = total_;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                uint64_t upper = highest_in_bucket(i);
+                return upper < max_ ? upper : max_;
+            }
+        }
+        return max_;
+    }
+
+private:
+    static size_t index_of(uint64_t value) {
+        if (value < SUB_COUNT)
+            return value;
+        int exponent = 63 - __builtin_clzll(value); // >= SUB_BITS
+        int shift = exponent - SUB_BITS;
+        uint64_t sub = (value >> shift) - SUB_COUNT;
+        return SUB_COUNT + (size_t)shift * SUB_COUNT + sub;
+    }
+
+    static uint64_t highest_in_bucket(size_t index) {
+        if (index < SUB_COUNT)
+            return index;
+        size_t shift = (index - SUB_COUNT) / SUB_COUNT;
+        uint64_t sub = (index - SUB_COUNT) % SUB_COUNT;
+        uint64_t lowest = (SUB_COUNT + sub) << shift;
+        return lowest + ((1ULL << shift) - 1);
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t min_ = UINT64_MAX;
+    uint64_t max_ = 0;
+};
+
+#endif // HDR_HISTOGRAM_H
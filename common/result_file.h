@@ -0,0 +1,206 @@
+#ifndef RESULT_FILE_H
+#define RESULT_FILE_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Двоичный файл результатов: заголовок и массив записей фиксированного размера.
+// Файл заранее резервируется через fallocate и отображается в память, поэтому
+// добавление записи — атомарный сдвиг счётчика в заголовке и запись в память,
+// без системного вызова на каждую запись. Дописывать в один файл могут
+// одновременно несколько процессов.
+
+const char RESULT_FILE_MAGIC[8] = {'R', 'E', 'S', 'U', 'L', 'T', 'S', '\0'};
+const uint32_t RESULT_FILE_VERSION = 1;
+const uint64_t RESULT_FILE_DEFAULT_CAPACITY = 1 << 16; // записей
+
+struct ResultRecord {
+    int32_t number;
+    uint32_t committed;   // 1 — запись полностью заполнена
+    int64_t timestamp_ns; // CLOCK_REALTIME
+};
+
+struct ResultHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    std::atomic<uint64_t> capacity; // размер файла в записях
+    std::atomic<uint64_t> count;    // число зарезервированных записей
+    char padding[32];
+};
+
+static_assert(sizeof(ResultHeader) == 64, "заголовок занимает одну кэш-линию");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "счётчики должны работать без блокировок между процессами");
+
+struct ResultFile {
+    int fd = -1;
+    ResultHeader* header = nullptr;
+    ResultRecord* records = nullptr;
+    uint64_t capacity = 0; // сколько записей отображено в этом процессе
+};
+
+inline size_t result_file_bytes(uint64_t capacity) {
+    return sizeof(ResultHeader) + capacity * sizeof(ResultRecord);
+}
+
+// Резервирует место на диске; если ФС не поддерживает fallocate, просто растягивает файл
+inline bool result_file_reserve_space(int fd, uint64_t capacity) {
+    off_t size = result_file_bytes(capacity);
+    if (fallocate(fd, 0, 0, size) == 0)
+        return true;
+    if (errno != EOPNOTSUPP)
+        return false;
+    return ftruncate(fd, size) == 0;
+}
+
+inline bool result_file_map(ResultFile& rf, uint64_t capacity) {
+    void* mem = mmap(nullptr, result_file_bytes(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, rf.fd, 0);
+    if (mem == MAP_FAILED)
+        return false;
+    rf.header = (ResultHeader*)mem;
+    rf.records = (ResultRecord*)((char*)mem + sizeof(ResultHeader));
+    rf.capacity = capacity;
+    return true;
+}
+
+// Открывает файл результатов, создавая его при необходимости
+inline bool result_file_open(ResultFile& rf, const char* path, uint64_t capacity = RESULT_FILE_DEFAULT_CAPACITY) {
+    rf.fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (rf.fd == -1)
+        return false;
+
+    // Инициализацию выполняет только один процесс
+    flock(rf.fd, LOCK_EX);
+    struct stat st;
+    bool ok = fstat(rf.fd, &st) == 0;
+    if (ok && st.st_size == 0) {
+        ok = result_file_reserve_space(rf.fd, capacity) && result_file_map(rf, capacity);
+        if (ok) {
+            memcpy(rf.header->magic, RESULT_FILE_MAGIC, sizeof(RESULT_FILE_MAGIC));
+            rf.header->version = RESULT_FILE_VERSION;
+            rf.header->record_size = sizeof(ResultRecord);
+            rf.header->capacity.store(capacity);
+            rf.header->count.store(0);
+        }
+    } else if (ok && (size_t)st.st_size >= sizeof(ResultHeader)) {
+        ok = result_file_map(rf, (st.st_size - sizeof(ResultHeader)) / sizeof(ResultRecord));
+        ok = ok && memcmp(rf.header->magic, RESULT_FILE_MAGIC, sizeof(RESULT_FILE_MAGIC)) == 0 &&
+             rf.header->version == RESULT_FILE_VERSION && rf.header->record_size == sizeof(ResultRecord);
+    } else {
+        ok = false;
+    }
+    flock(rf.fd, LOCK_UN);
+
+    if (!ok) {
+        if (rf.header)
+            munmap(rf.header, result_file_bytes(rf.capacity));
+        close(rf.fd);
+        rf = ResultFile();
+    }
+    return ok;
+}
+
+// Увеличивает файл (вдвое) так, чтобы в него поместилось needed записей
+inline bool result_file_grow(ResultFile& rf, uint64_t needed) {
+    flock(rf.fd, LOCK_EX);
+    uint64_t capacity = rf.header->capacity.load();
+    bool ok = true;
+    if (capacity < needed) {
+        capacity = capacity * 2 > needed ? capacity * 2 : needed;
+        ok = result_file_reserve_space(rf.fd, capacity);
+        if (ok)
+            rf.header->capacity.store(capacity);
+    }
+    if (ok) {
+        void* mem = mremap(rf.header, result_file_bytes(rf.capacity), result_file_bytes(capacity), MREMAP_MAYMOVE);
+        ok = mem != MAP_FAILED;
+        if (ok) {
+            rf.header = (ResultHeader*)mem;
+            rf.records = (ResultRecord*)((char*)mem + sizeof(ResultHeader));
+            rf.capacity = capacity;
+        }
+    }
+    flock(rf.fd, LOCK_UN);
+    return ok;
+}
+
+// Резервирует n подряд идущих записей; возвращает указатель на первую
+inline ResultRecord* result_file_reserve(ResultFile& rf, uint64_t n) {
+    uint64_t index = rf.header->count.fetch_add(n, std::memory_order_relaxed);
+    if (index + n > rf.capacity && !result_file_grow(rf, index + n))
+        return nullptr;
+    return rf.records + index;
+}
+
+inline void result_record_fill(ResultRecord& record, int number, int64_t timestamp_ns) {
+    record.number = number;
+    record.timestamp_ns = timestamp_ns;
+    __atomic_store_n(&record.committed, 1, __ATOMIC_RELEASE);
+}
+
+inline int64_t result_timestamp_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+inline bool result_file_append(ResultFile& rf, int number) {
+    ResultRecord* record = result_file_reserve(rf, 1);
+    if (!record)
+        return false;
+    result_record_fill(*record, number, result_timestamp_ns());
+    return true;
+}
+
+// Пакетная запись: одна атомарная операция на весь пакет
+inline bool result_file_append_batch(ResultFile& rf, const int* numbers, uint64_t n) {
+    ResultRecord* records = result_file_reserve(rf, n);
+    if (!records)
+        return false;
+    int64_t timestamp = result_timestamp_ns();
+    for (uint64_t i = 0; i < n; ++i)
+        result_record_fill(records[i], numbers[i], timestamp);
+    return true;
+}
+
+inline void result_file_close(ResultFile& rf) {
+    if (rf.header)
+        munmap(rf.header, result_file_bytes(rf.capacity));
+    if (rf.fd != -1)
+        close(rf.fd);
+    rf = ResultFile();
+}
+
+// Выгружает записанные числа в текстовый файл, по одному в строке.
+// Зарезервированные, но не заполненные записи пропускаются.
+inline bool result_file_export(const char* bin_path, const char* txt_path) {
+    ResultFile rf;
+    if (access(bin_path, F_OK) != 0 || !result_file_open(rf, bin_path, 0))
+        return false;
+    FILE* out = fopen(txt_path, "w");
+    if (!out) {
+        result_file_close(rf);
+        return false;
+    }
+    uint64_t count = rf.header->count.load();
+    if (count > rf.capacity)
+        count = rf.capacity;
+    for (uint64_t i = 0; i < count; ++i) {
+        if (__atomic_load_n(&rf.records[i].committed, __ATOMIC_ACQUIRE))
+            fprintf(out, "%d\n", rf.records[i].number);
+    }
+    fclose(out);
+    result_file_close(rf);
+    return true;
+}
+
+#endif // RESULT_FILE_H
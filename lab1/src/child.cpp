@@ -3,6 +3,7 @@
 #include <fcntl.h>
 #include <cmath>
 #include <cstring>
+#include "../../common/result_file.h"
 
 bool is_composite(int n) {
     if (n < 2) return false; // Отрицательное или 0, 1
@@ -12,7 +13,10 @@ bool is_composite(int n) {
     return false; // Число простое
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // --mmap: дописывать результат в отображаемый в память result.bin вместо перезаписи result.txt
+    bool use_mmap = argc > 1 && strcmp(argv[1], "--mmap") == 0;
+
     int number;
     if (read(STDIN_FILENO, &number, sizeof(number)) == -1) {
         std::cerr << "Ошибка при чтении числа" << std::endl;
@@ -23,9 +27,16 @@ int main() {
         return 1; // Число отрицательное
     }
 
-    if (is_composite(number)) {
+    if (is_composite(number) && use_mmap) {
+        ResultFile results;
+        if (!result_file_open(results, "result.bin") || !result_file_append(results, number)) {
+            std::cerr << "Ошибка при записи в файл" << std::endl;
+            return 1;
+        }
+        result_file_close(results);
+    } else if (is_composite(number)) {
         // Если число составное, записываем его в файл
-        int file = open("result.txt", O_WRONLY | O_CREAT | O_TRUNC);
+        int file = open("result.txt", O_WRONLY | O_CREAT | O_TRUNC, 0666);
         if (file == -1) {
             std::cerr << "Ошибка при открытии файла" << std::endl;
             return 1;
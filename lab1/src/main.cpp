@@ -3,9 +3,21 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <cstring>
+#include "../../common/result_file.h"
 
+int main(int argc, char* argv[]) {
+    // --export: выгрузить накопленный result.bin в result.txt
+    if (argc > 1 && strcmp(argv[1], "--export") == 0) {
+        if (!result_file_export("result.bin", "result.txt")) {
+            std::cout << "Ошибка при выгрузке результатов" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    // --mmap: дочерний процесс дописывает результаты в result.bin
+    bool use_mmap = argc > 1 && strcmp(argv[1], "--mmap") == 0;
 
-int main() {
     int fd1[2], fd2[2];
 
     if (pipe(fd1) < 0 || pipe(fd2) < 0) {
@@ -58,7 +70,10 @@ int main() {
         }
 
         // Запуск дочернего процесса
-        execl("./child", "child", NULL);
+        if (use_mmap)
+            execl("./child", "child", "--mmap", NULL);
+        else
+            execl("./child", "child", NULL);
         std::cout << "Ошибка при вызове execl" << std::endl;
         return 1;
     }
@@ -0,0 +1,235 @@
+// Сравнение обмена через пару семафоров (один слот SharedData, как было в lab3)
+// с кольцевыми буферами SpscRing. Дочерний процесс создаётся fork без exec.
+// Также измеряется время создания экземпляра: memfd против именованных объектов.
+// Режим pool: масштабирование пула обработчиков от 1 до числа ядер.
+// Сборка: g++ -O2 bench.cpp -o bench; запуск: ./bench [число сообщений] | ./bench pool [число чисел]
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "shared.h"
+
+// Прежняя схема: одно число и строка ответа, по семафору на каждое направление
+struct HandshakeData {
+    sem_t sem_parent;
+    sem_t sem_child;
+    int number;
+    char message[256];
+};
+
+int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void* map_shared(size_t size) {
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        std::cerr << "Ошибка при отображении разделяемой памяти" << std::endl;
+        exit(1);
+    }
+    return mem;
+}
+
+void print_latency(const char* name, std::vector<int64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    std::cout << name << ": p50 = " << samples[n / 2] << " нс, p99 = " << samples[n * 99 / 100]
+              << " нс, max = " << samples[n - 1] << " нс" << std::endl;
+}
+
+void print_throughput(const char* name, int count, int64_t elapsed_ns) {
+    std::cout << name << ": " << (int64_t)(count * 1e9 / elapsed_ns) << " сообщений/с" << std::endl;
+}
+
+void handshake_child(HandshakeData* data, int count) {
+    for (int i = 0; i < count; ++i) {
+        sem_wait(&data->sem_child);
+        const char* text = status_message(is_composite(data->number) ? STATUS_COMPOSITE : STATUS_PRIME);
+        strncpy(data->message, text, sizeof(data->message));
+        sem_post(&data->sem_parent);
+    }
+}
+
+void bench_handshake(int count) {
+    HandshakeData* data = (HandshakeData*)map_shared(sizeof(HandshakeData));
+    sem_init(&data->sem_parent, 1, 0);
+    sem_init(&data->sem_child, 1, 0);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        handshake_child(data, count);
+        _exit(0);
+    }
+
+    // Каждый обмен — полный круг: пока ответа нет, следующее число не отправить
+    std::vector<int64_t> samples(count);
+    int64_t start = now_ns();
+    for (int i = 0; i < count; ++i) {
+        int64_t sent = now_ns();
+        data->number = i;
+        sem_post(&data->sem_child);
+        sem_wait(&data->sem_parent);
+        samples[i] = now_ns() - sent;
+    }
+    int64_t elapsed = now_ns() - start;
+    waitpid(pid, nullptr, 0);
+
+    print_latency("Семафоры, задержка круга", samples);
+    print_throughput("Семафоры, пропускная способность", count, elapsed);
+    sem_destroy(&data->sem_parent);
+    sem_destroy(&data->sem_child);
+    munmap(data, sizeof(HandshakeData));
+}
+
+void ring_child(SharedData* data) {
+    SpinBudget recv_budget, send_budget;
+    Request request;
+    while (true) {
+        data->requests.pop(request, recv_budget);
+        if (request.kind == REQUEST_STOP)
+            break;
+        Response response = {request.number, is_composite(request.number) ? STATUS_COMPOSITE : STATUS_PRIME};
+        data->responses.push(response, send_budget);
+    }
+}
+
+void bench_ring(int count) {
+    SharedData* data = (SharedData*)map_shared(sizeof(SharedData));
+    pid_t pid = fork();
+    if (pid == 0) {
+        ring_child(data);
+        _exit(0);
+    }
+
+    SpinBudget send_budget, recv_budget;
+    Response response;
+
+    // Задержка: одно сообщение в полёте
+    std::vector<int64_t> samples(count);
+    for (int i = 0; i < count; ++i) {
+        int64_t sent = now_ns();
+        data->requests.push({REQUEST_NUMBER, i}, send_budget);
+        data->responses.pop(response, recv_budget);
+        samples[i] = now_ns() - sent;
+    }
+    print_latency("Кольцевой буфер, задержка круга", samples);
+
+    // Пропускная способность: поток чисел, ответы забираются по мере появления
+    int sent = 0, received = 0;
+    int64_t start = now_ns();
+    while (received < count) {
+        while (sent < count && sent - received < (int)RING_CAPACITY &&
+               data->requests.try_push({REQUEST_NUMBER, sent}))
+            ++sent;
+        if (!data->responses.try_pop(response))
+            data->responses.pop(response, recv_budget);
+        ++received;
+    }
+    int64_t elapsed = now_ns() - start;
+    print_throughput("Кольцевой буфер, пропускная способность", count, elapsed);
+
+    data->requests.push({REQUEST_STOP, 0}, send_budget);
+    waitpid(pid, nullptr, 0);
+    munmap(data, sizeof(SharedData));
+}
+
+// Создание и удаление разделяемой памяти одного запуска lab3, в микросекундах
+void bench_startup() {
+    const int runs = 1000;
+    int64_t start = now_ns();
+    for (int i = 0; i < runs; ++i) {
+        int fd = shm_open("/bench_shared_memory", O_CREAT | O_RDWR, 0666);
+        ftruncate(fd, sizeof(HandshakeData));
+        void* mem = mmap(nullptr, sizeof(HandshakeData), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        sem_t* sem_parent = sem_open("/bench_sem_parent", O_CREAT, 0666, 0);
+        sem_t* sem_child = sem_open("/bench_sem_child", O_CREAT, 0666, 0);
+        sem_close(sem_parent);
+        sem_close(sem_child);
+        sem_unlink("/bench_sem_parent");
+        sem_unlink("/bench_sem_child");
+        munmap(mem, sizeof(HandshakeData));
+        close(fd);
+        shm_unlink("/bench_shared_memory");
+    }
+    std::cout << "Именованные shm и семафоры: " << (now_ns() - start) / runs / 1000.0 << " мкс на запуск" << std::endl;
+
+    start = now_ns();
+    for (int i = 0; i < runs; ++i) {
+        int fd = memfd_create("bench_shared", 0);
+        ftruncate(fd, sizeof(SharedData));
+        SharedData* data = (SharedData*)mmap(nullptr, sizeof(SharedData), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        init_shared_data(data, 1);
+        munmap(data, sizeof(SharedData));
+        close(fd);
+    }
+    std::cout << "memfd и робастные мьютексы: " << (now_ns() - start) / runs / 1000.0 << " мкс на запуск" << std::endl;
+}
+
+// Время обработки count чисел пулом из workers процессов, в секундах
+double run_pool(PoolData* pool, int workers, int count) {
+    memset((void*)pool, 0, sizeof(PoolData));
+    for (int i = 0; i < workers; ++i) {
+        if (fork() == 0) {
+            run_pool_worker(*pool, i, [](const int32_t*, uint32_t) { return true; });
+            _exit(0);
+        }
+    }
+
+    // Большие числа, чтобы проверка на составность была заметной работой
+    SpinBudget budget;
+    WorkBatch batch;
+    batch.count = 0;
+    int64_t start = now_ns();
+    for (int i = 0; i < count; ++i) {
+        batch.numbers[batch.count++] = 1000000000 + i;
+        if (batch.count == BATCH_SIZE) {
+            pool->work.push(batch, budget);
+            batch.count = 0;
+        }
+    }
+    if (batch.count > 0)
+        pool->work.push(batch, budget);
+    pool->work.close();
+    while (wait(nullptr) > 0) {}
+    return (now_ns() - start) / 1e9;
+}
+
+void bench_pool(int count) {
+    PoolData* pool = (PoolData*)map_shared(sizeof(PoolData));
+    int cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > MAX_WORKERS)
+        cores = MAX_WORKERS;
+    double base = 0;
+    for (int workers = 1; workers <= cores; ++workers) {
+        double elapsed = run_pool(pool, workers, count);
+        if (workers == 1)
+            base = elapsed;
+        std::cout << "Обработчиков: " << workers << ", " << (int64_t)(count / elapsed)
+                  << " чисел/с, ускорение " << base / elapsed << std::endl;
+    }
+    munmap(pool, sizeof(PoolData));
+}
+
+int main(int argc, char* argv[]) {
+    bool pool = argc > 1 && strcmp(argv[1], "pool") == 0;
+    int count = argc > 1 + pool ? atoi(argv[1 + pool]) : 200000;
+    if (count <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [messages] | " << argv[0] << " pool [numbers]" << std::endl;
+        return 1;
+    }
+    if (pool) {
+        bench_pool(count);
+        return 0;
+    }
+    bench_startup();
+    bench_handshake(count);
+    bench_ring(count);
+    return 0;
+}
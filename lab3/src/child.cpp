@@ -1,29 +1,96 @@
 #include <iostream>
 #include <sys/mman.h>
 #include <fcntl.h>
-#include <semaphore.h>
 #include <unistd.h>
-#include <cmath>
 #include <cstring>
+#include "shared.h"
+#include "../../common/result_file.h"
 
-struct SharedData {
-    int number;
-    char message[256];
-};
+// Обработчик пула: берёт пакеты из общей очереди до её закрытия
+void run_pool_child(SharedData* shared_data, int index, bool use_mmap) {
+    auto parent_alive = [&] { return process_alive(shared_data->parent); };
+    ResultFile results;
+    int file = -1;
+    bool file_ok = use_mmap ? result_file_open(results, "result.bin")
+                            : (file = open("result.txt", O_WRONLY | O_APPEND)) != -1;
 
-bool is_composite(int n) {
-    if (n < 2) return false; // Отрицательное, 0 или 1
-    for (int i = 2; i <= sqrt(n); ++i) {
-        if (n % i == 0) return true; // Составное число
+    run_pool_worker(shared_data->pool, index, [&](const int32_t* numbers, uint32_t count) {
+        if (!file_ok)
+            return false;
+        if (use_mmap)
+            return result_file_append_batch(results, numbers, count);
+        // Весь пакет одним write: с O_APPEND строки разных процессов не перемешиваются
+        char buffer[BATCH_SIZE * 12];
+        int length = 0;
+        for (uint32_t i = 0; i < count; ++i)
+            length += snprintf(buffer + length, sizeof(buffer) - length, "%d\n", numbers[i]);
+        return write(file, buffer, length) == length;
+    }, parent_alive);
+
+    if (use_mmap)
+        result_file_close(results);
+    else if (file != -1)
+        close(file);
+}
+
+// Постоянный дочерний процесс: отвечает на каждое число до запроса остановки
+void run_single_child(SharedData* shared_data, bool use_mmap) {
+    // Файл результатов открывается один раз на весь поток чисел
+    ResultFile results;
+    int file = -1;
+    bool file_ok = use_mmap ? result_file_open(results, "result.bin")
+                            : (file = open("result.txt", O_WRONLY | O_CREAT | O_TRUNC, 0666)) != -1;
+
+    SpinBudget recv_budget, send_budget;
+    auto parent_alive = [&] { return process_alive(shared_data->parent); };
+    while (true) {
+        // Ожидание числа от родительского процесса; если он упал, завершаемся
+        Request request;
+        if (!shared_data->requests.pop(request, recv_budget, parent_alive) || request.kind == REQUEST_STOP)
+            break;
+
+        Response response = {request.number, STATUS_PRIME};
+        if (request.number < 0) {
+            response.status = STATUS_NEGATIVE;
+        } else if (is_composite(request.number)) {
+            // Запись в файл, если число составное
+            bool written = file_ok && (use_mmap ? result_file_append(results, request.number)
+                                                : dprintf(file, "%d\n", request.number) > 0);
+            response.status = written ? STATUS_COMPOSITE : STATUS_FILE_ERROR;
+        }
+
+        // Уведомляем родительский процесс
+        if (!shared_data->responses.push(response, send_budget, parent_alive))
+            break;
     }
-    return false; // Простое число
+
+    if (use_mmap)
+        result_file_close(results);
+    else if (file != -1)
+        close(file);
 }
 
-int main() {
-    // Открытие разделяемой памяти
-    int fd = shm_open("/my_shared_memory", O_RDWR, 0666);
-    if (fd == -1) {
-        std::cerr << "Ошибка при открытии разделяемой памяти" << std::endl;
+int main(int argc, char* argv[]) {
+    // --mmap: дописывать результаты в отображаемый в память result.bin вместо result.txt
+    // --pool <index>: работать обработчиком пула с указанным номером слота
+    // --fd <n>: унаследованный от родителя дескриптор разделяемой памяти
+    bool use_mmap = false;
+    int pool_index = -1;
+    int fd = -1;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--mmap") == 0)
+            use_mmap = true;
+        else if (strcmp(argv[i], "--pool") == 0 && i + 1 < argc)
+            pool_index = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--fd") == 0 && i + 1 < argc)
+            fd = atoi(argv[++i]);
+    }
+    if (pool_index >= MAX_WORKERS) {
+        std::cerr << "Неверный номер обработчика" << std::endl;
+        return 1;
+    }
+    if (fd < 0) {
+        std::cerr << "Не передан дескриптор разделяемой памяти" << std::endl;
         return 1;
     }
 
@@ -34,41 +101,21 @@ int main() {
         std::cerr << "Ошибка при отображении разделяемой памяти" << std::endl;
         return 1;
     }
+    close(fd);
 
-    // Открытие семафоров
-    sem_t* sem_parent = sem_open("/sem_parent", 0);
-    sem_t* sem_child = sem_open("/sem_child", 0);
-    if (sem_parent == SEM_FAILED || sem_child == SEM_FAILED) {
-        std::cerr << "Ошибка при открытии семафоров" << std::endl;
+    ProcessLock& self = shared_data->children[pool_index >= 0 ? pool_index : 0];
+    if (!process_lock_acquire(self)) {
+        std::cerr << "Ошибка при подключении к разделяемой памяти" << std::endl;
         return 1;
     }
 
-    // Ожидание числа от родительского процесса
-    sem_wait(sem_child);
-
-    int number = shared_data->number;
-    if (number < 0) {
-        strncpy(shared_data->message, "Число отрицательное", sizeof(shared_data->message));
-    } else {
-        // Проверка числа
-        if (is_composite(number)) {
-            // Запись в файл, если число составное
-            int file = open("result.txt", O_WRONLY | O_CREAT | O_TRUNC, 0666);
-            if (file != -1) {
-                dprintf(file, "%d\n", number);
-                close(file);
-                strncpy(shared_data->message, "Число составное, записано в файл", sizeof(shared_data->message));
-            } else {
-                strncpy(shared_data->message, "Ошибка записи в файл", sizeof(shared_data->message));
-            }
-        } else {
-            strncpy(shared_data->message, "Число простое", sizeof(shared_data->message));
-        }
-    }
-
-    sem_post(sem_parent); // Уведомляем родительский процесс
+    if (pool_index >= 0)
+        run_pool_child(shared_data, pool_index, use_mmap);
+    else
+        run_single_child(shared_data, use_mmap);
 
     // Завершаем работу
+    process_lock_release(self);
     munmap(shared_data, shared_size);
     return 0;
 }
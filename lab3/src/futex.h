@@ -0,0 +1,90 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Ожидание на 32-битном слове в разделяемой памяти: сначала активное ожидание,
+// затем сон в futex. Флаг FUTEX_PRIVATE не используется — слово видят разные процессы.
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex работает с обычным 32-битным словом");
+
+inline long futex_wait(std::atomic<uint32_t>* word, uint32_t expected, const struct timespec* timeout = nullptr) {
+    return syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+inline long futex_wake(std::atomic<uint32_t>* word, int count) {
+    return syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Адаптивная длительность активного ожидания: растёт, если данные успевали прийти
+// во время спина, и уменьшается, если всё равно приходилось засыпать.
+// Хранится локально в процессе, а не в разделяемой памяти. На одном ядре спин
+// бесполезен — вторая сторона не может работать, пока мы крутимся, — поэтому он отключается.
+struct SpinBudget {
+    static const uint32_t MIN_SPINS = 16;
+    static const uint32_t MAX_SPINS = 1 << 14;
+    uint32_t spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? 1024 : 0;
+
+    void hit() {
+        if (spins != 0 && spins < MAX_SPINS) spins *= 2;
+    }
+    void miss() {
+        if (spins > MIN_SPINS) spins /= 2;
+    }
+};
+
+inline bool always_alive() {
+    return true;
+}
+
+// Ждёт, пока ready() не вернёт true. word меняется при каждом событии, waiters —
+// счётчик спящих: по нему пишущая сторона решает, нужен ли futex_wake.
+// Все операции seq_cst: иначе пробуждение может потеряться между проверкой и сном.
+// Сон ограничен WAIT_CHECK_NS, после чего проверяется alive(): если вторая сторона
+// завершилась аварийно, ожидание прекращается и возвращается false.
+const long WAIT_CHECK_NS = 50 * 1000 * 1000;
+
+template <typename Ready, typename Alive>
+bool wait_until(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiters, SpinBudget& budget, Ready ready,
+                Alive alive) {
+    for (uint32_t i = 0; i < budget.spins; ++i) {
+        if (ready()) {
+            budget.hit();
+            return true;
+        }
+        cpu_relax();
+    }
+    budget.miss();
+    const struct timespec timeout = {0, WAIT_CHECK_NS};
+    while (!ready()) {
+        waiters.fetch_add(1);
+        uint32_t seen = word.load();
+        long rc = ready() ? 0 : futex_wait(&word, seen, &timeout);
+        waiters.fetch_sub(1);
+        if (rc == -1 && errno == ETIMEDOUT && !alive())
+            return ready();
+    }
+    return true;
+}
+
+// Будит всех ожидающих на word, если такие есть
+inline void notify(std::atomic<uint32_t>& word, std::atomic<uint32_t>& waiters) {
+    if (waiters.load() != 0)
+        futex_wake(&word, INT32_MAX);
+}
+
+#endif // FUTEX_H
@@ -1,27 +1,165 @@
 #include <iostream>
 #include <sys/mman.h>
 #include <fcntl.h>
-#include <semaphore.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <chrono>
 #include <cstring>
+#include <string>
+#include <vector>
+#include "shared.h"
+#include "../../common/result_file.h"
 
-struct SharedData {
+// Запуск дочернего процесса; extra_args — аргументы после имени программы.
+// Дескриптор разделяемой памяти наследуется через execv (он открыт без CLOEXEC).
+pid_t spawn_child(const std::vector<std::string>& extra_args) {
+    pid_t pid = fork();
+    if (pid != 0)
+        return pid;
+    std::vector<char*> args = {(char*)"child"};
+    for (const std::string& arg : extra_args)
+        args.push_back((char*)arg.c_str());
+    args.push_back(nullptr);
+    execv("./child", args.data());
+    std::cerr << "Ошибка при вызове дочернего процесса" << std::endl;
+    _exit(1);
+}
+
+// Один постоянный дочерний процесс, ответ на каждое число
+bool run_single(SharedData* shared_data) {
+    SpinBudget send_budget, recv_budget;
+    auto child_alive = [&] { return process_alive(shared_data->children[0]); };
+    int in_flight = 0;
+    auto print_result = [&] {
+        Response response;
+        if (!shared_data->responses.pop(response, recv_budget, child_alive))
+            return false;
+        --in_flight;
+        std::cout << "Результат: " << response.number << " — " << status_message(response.status) << '\n';
+        return true;
+    };
+    auto child_failed = [] {
+        std::cerr << "Дочерний процесс аварийно завершился" << std::endl;
+        return false;
+    };
+
+    // Дочерний процесс обрабатывает поток чисел до конца ввода. Пока во входном
+    // буфере есть готовые числа, отправляем их не дожидаясь ответов.
+    std::cout << "Введите числа (по одному в строке, Ctrl+D — завершение):" << std::endl;
+    int number;
+    while (std::cin >> number) {
+        if (!shared_data->requests.push({REQUEST_NUMBER, number}, send_budget, child_alive))
+            return child_failed();
+        ++in_flight;
+        // Пропускаем уже прочитанный конец строки, не блокируясь на вводе
+        while (std::cin.rdbuf()->in_avail() > 0 && isspace(std::cin.peek()))
+            std::cin.get();
+        if (in_flight == (int)RING_CAPACITY || std::cin.rdbuf()->in_avail() <= 0) {
+            while (in_flight > 0) {
+                if (!print_result())
+                    return child_failed();
+            }
+            std::cout.flush();
+        }
+    }
+    while (in_flight > 0) {
+        if (!print_result())
+            return child_failed();
+    }
+    shared_data->requests.push({REQUEST_STOP, 0}, send_budget, child_alive);
+    return true;
+}
+
+// Пул обработчиков: числа раздаются пакетами, в конце печатается сводка
+bool run_pool(SharedData* shared_data, int workers) {
+    PoolData& pool = shared_data->pool;
+    SpinBudget budget;
+    WorkBatch batch;
+    batch.count = 0;
+    auto any_worker_alive = [&] {
+        for (int i = 0; i < workers; ++i) {
+            if (process_alive(shared_data->children[i]))
+                return true;
+        }
+        return false;
+    };
+    bool ok = true;
+
+    auto start = std::chrono::steady_clock::now();
     int number;
-    char message[256];
-};
+    while (ok && std::cin >> number) {
+        batch.numbers[batch.count++] = number;
+        if (batch.count == BATCH_SIZE) {
+            ok = pool.work.push(batch, budget, any_worker_alive);
+            batch.count = 0;
+        }
+    }
+    if (ok && batch.count > 0)
+        ok = pool.work.push(batch, budget, any_worker_alive);
+    // Закрытие очереди: обработчики доберут оставшиеся пакеты и завершатся
+    pool.work.close();
+    int status;
+    while (wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ok = false;
+    }
+    for (int i = 0; i < workers; ++i) {
+        if (shared_data->children[i].state.load() != PROCESS_EXITED) {
+            std::cerr << "Обработчик " << i << " аварийно завершился, его пакеты потеряны" << std::endl;
+            ok = false;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-int main() {
-    // Размер общей памяти
-    size_t shared_size = sizeof(SharedData);
+    uint64_t total = 0;
+    for (int i = 0; i < workers; ++i) {
+        WorkerSlot& slot = pool.workers[i];
+        std::cout << "Обработчик " << i << ": чисел " << slot.processed << ", составных " << slot.composite
+                  << ", простых " << slot.prime << ", отрицательных " << slot.negative;
+        if (slot.file_errors > 0)
+            std::cout << ", ошибок записи " << slot.file_errors;
+        std::cout << std::endl;
+        total += slot.processed;
+    }
+    std::cout << "Всего: " << total << " чисел за " << elapsed << " с" << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    bool use_mmap = false;
+    int workers = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--export") == 0) {
+            // Выгрузить накопленный result.bin в result.txt
+            if (!result_file_export("result.bin", "result.txt")) {
+                std::cerr << "Ошибка при выгрузке результатов" << std::endl;
+                return 1;
+            }
+            return 0;
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            // Дочерние процессы дописывают результаты в result.bin
+            use_mmap = true;
+        } else if (strcmp(argv[i], "--pool") == 0 && i + 1 < argc) {
+            // Пул из N обработчиков вместо одного дочернего процесса
+            workers = atoi(argv[++i]);
+            if (workers <= 0 || workers > MAX_WORKERS) {
+                std::cerr << "Число обработчиков должно быть от 1 до " << MAX_WORKERS << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--mmap] [--pool <workers>] | --export" << std::endl;
+            return 1;
+        }
+    }
 
-    // Создание разделяемой памяти
-    int fd = shm_open("/my_shared_memory", O_CREAT | O_RDWR, 0666);
-    if (fd == -1) {
+    // Создание разделяемой памяти: анонимный memfd без имени, поэтому параллельные
+    // запуски не пересекаются, а после аварии не остаётся «висящих» объектов
+    size_t shared_size = sizeof(SharedData);
+    int fd = memfd_create("lab3_shared", 0);
+    if (fd == -1 || ftruncate(fd, shared_size) == -1) {
         std::cerr << "Ошибка при создании разделяемой памяти" << std::endl;
         return 1;
     }
-    ftruncate(fd, shared_size);
 
     // Отображение памяти
     SharedData* shared_data = (SharedData*)mmap(nullptr, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
@@ -29,50 +167,45 @@ int main() {
         std::cerr << "Ошибка при отображении разделяемой памяти" << std::endl;
         return 1;
     }
-
-    // Создание семафоров
-    sem_t* sem_parent = sem_open("/sem_parent", O_CREAT, 0666, 0);
-    sem_t* sem_child = sem_open("/sem_child", O_CREAT, 0666, 0);
-    if (sem_parent == SEM_FAILED || sem_child == SEM_FAILED) {
-        std::cerr << "Ошибка при создании семафоров" << std::endl;
-        return 1;
-    }
-
-    // Создание дочернего процесса
-    pid_t pid = fork();
-    if (pid < 0) {
-        std::cerr << "Ошибка при создании дочернего процесса" << std::endl;
+    int children = workers > 0 ? workers : 1;
+    if (!init_shared_data(shared_data, children) || !process_lock_acquire(shared_data->parent)) {
+        std::cerr << "Ошибка при инициализации разделяемой памяти" << std::endl;
         return 1;
     }
 
-    if (pid > 0) { // Родительский процесс
-        std::cout << "Введите число: ";
-        int number;
-        std::cin >> number;
-
-        // Запись числа в разделяемую память
-        shared_data->number = number;
-        sem_post(sem_child); // Уведомляем дочерний процесс
+    // В режиме пула обработчики дописывают в общий result.txt, поэтому он очищается один раз здесь
+    if (workers > 0 && !use_mmap)
+        close(open("result.txt", O_WRONLY | O_CREAT | O_TRUNC, 0666));
 
-        // Ожидание результата от дочернего процесса
-        sem_wait(sem_parent);
-        std::cout << "Результат: " << shared_data->message << std::endl;
-
-        // Завершаем работу
-        waitpid(pid, nullptr, 0);
+    // Создание дочерних процессов
+    std::ios::sync_with_stdio(false);
+    for (int i = 0; i < children; ++i) {
+        std::vector<std::string> args = {"--fd", std::to_string(fd)};
+        if (workers > 0) {
+            args.push_back("--pool");
+            args.push_back(std::to_string(i));
+        }
+        if (use_mmap)
+            args.push_back("--mmap");
+        pid_t pid = spawn_child(args);
+        if (pid < 0) {
+            std::cerr << "Ошибка при создании дочернего процесса" << std::endl;
+            return 1;
+        }
+        shared_data->children[i].pid = pid;
+    }
+    close(fd);
 
-        // Удаление ресурсов
-        munmap(shared_data, shared_size);
-        shm_unlink("/my_shared_memory");
-        sem_close(sem_parent);
-        sem_close(sem_child);
-        sem_unlink("/sem_parent");
-        sem_unlink("/sem_child");
-    } else { // Дочерний процесс
-        execl("./child", "child", nullptr);
-        std::cerr << "Ошибка при вызове дочернего процесса" << std::endl;
-        return 1;
+    bool ok;
+    if (workers > 0) {
+        ok = run_pool(shared_data, workers);
+    } else {
+        ok = run_single(shared_data);
+        wait(nullptr);
     }
 
-    return 0;
+    // Удаление ресурсов
+    process_lock_release(shared_data->parent);
+    munmap(shared_data, shared_size);
+    return ok ? 0 : 1;
 }
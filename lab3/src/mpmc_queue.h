@@ -0,0 +1,125 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include "futex.h"
+
+// Ограниченная очередь «много писателей — много читателей» (схема Вьюкова) для
+// разделяемой памяти. У каждой ячейки свой номер последовательности: писатель
+// занимает позицию, если sequence == pos, читатель — если sequence == pos + 1.
+// В ячейке хранится sequence минус её индекс, поэтому обнулённая память уже
+// является пустой очередью: init() не нужен, и страницы ячеек не трогаются
+// до первого использования.
+template <typename T, uint32_t Capacity>
+struct MpmcQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "ёмкость должна быть степенью двойки");
+
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        T value;
+    };
+
+    alignas(64) std::atomic<uint32_t> enqueue_pos;
+    alignas(64) std::atomic<uint32_t> dequeue_pos;
+    // Счётчики событий для futex: растут при каждой записи / чтении
+    alignas(64) std::atomic<uint32_t> push_events;
+    std::atomic<uint32_t> push_waiters;
+    alignas(64) std::atomic<uint32_t> pop_events;
+    std::atomic<uint32_t> pop_waiters;
+    // Писатели закончили работу: читатели выходят, как только очередь опустеет
+    alignas(64) std::atomic<uint32_t> closed;
+
+    alignas(64) Cell cells[Capacity];
+
+    static uint32_t load_sequence(Cell& cell, uint32_t pos) {
+        return cell.sequence.load(std::memory_order_acquire) + (pos & (Capacity - 1));
+    }
+
+    static void store_sequence(Cell& cell, uint32_t pos, uint32_t sequence) {
+        cell.sequence.store(sequence - (pos & (Capacity - 1)), std::memory_order_release);
+    }
+
+    bool try_push(const T& value) {
+        uint32_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & (Capacity - 1)];
+            int32_t diff = (int32_t)(load_sequence(*cell, pos) - pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // очередь заполнена
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        store_sequence(*cell, pos, pos + 1);
+        push_events.fetch_add(1);
+        notify(push_events, push_waiters);
+        return true;
+    }
+
+    bool try_pop(T& value) {
+        uint32_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[pos & (Capacity - 1)];
+            int32_t diff = (int32_t)(load_sequence(*cell, pos) - (pos + 1));
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // очередь пуста
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        value = cell->value;
+        store_sequence(*cell, pos, pos + Capacity);
+        pop_events.fetch_add(1);
+        notify(pop_events, pop_waiters);
+        return true;
+    }
+
+    // Есть ли опубликованный элемент в голове очереди
+    bool ready_to_pop() {
+        uint32_t pos = dequeue_pos.load();
+        return load_sequence(cells[pos & (Capacity - 1)], pos) == pos + 1;
+    }
+
+    bool ready_to_push() {
+        uint32_t pos = enqueue_pos.load();
+        return load_sequence(cells[pos & (Capacity - 1)], pos) == pos;
+    }
+
+    // Возвращает false, если alive() сообщил, что читателей не осталось
+    template <typename Alive = bool (*)()>
+    bool push(const T& value, SpinBudget& budget, Alive alive = always_alive) {
+        while (!try_push(value)) {
+            if (!wait_until(pop_events, pop_waiters, budget, [&] { return ready_to_push(); }, alive))
+                return false;
+        }
+        return true;
+    }
+
+    // Возвращает false, если очередь закрыта и пуста или писатель погиб
+    template <typename Alive = bool (*)()>
+    bool pop(T& value, SpinBudget& budget, Alive alive = always_alive) {
+        while (!try_pop(value)) {
+            if (closed.load())
+                return try_pop(value);
+            if (!wait_until(push_events, push_waiters, budget, [&] { return ready_to_pop() || closed.load(); }, alive))
+                return false;
+        }
+        return true;
+    }
+
+    void close() {
+        closed.store(1);
+        push_events.fetch_add(1);
+        futex_wake(&push_events, INT32_MAX);
+    }
+};
+
+#endif // MPMC_QUEUE_H
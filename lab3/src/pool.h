@@ -0,0 +1,33 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "mpmc_queue.h"
+
+// Режим пула: несколько дочерних процессов забирают числа из общей очереди.
+// Элемент очереди — пакет чисел, так что атомарные операции очереди
+// выполняются один раз на BATCH_SIZE чисел.
+
+const uint32_t BATCH_SIZE = 64;
+const uint32_t POOL_QUEUE_CAPACITY = 256; // пакетов
+const int MAX_WORKERS = 64;
+
+struct WorkBatch {
+    uint32_t count;
+    int32_t numbers[BATCH_SIZE];
+};
+
+// Результаты одного обработчика; пишет только он сам, поэтому отдельная кэш-линия
+struct alignas(64) WorkerSlot {
+    std::atomic<uint64_t> processed;
+    std::atomic<uint64_t> composite;
+    std::atomic<uint64_t> prime;
+    std::atomic<uint64_t> negative;
+    std::atomic<uint64_t> file_errors;
+};
+
+struct PoolData {
+    MpmcQueue<WorkBatch, POOL_QUEUE_CAPACITY> work;
+    WorkerSlot workers[MAX_WORKERS];
+};
+
+#endif // POOL_H
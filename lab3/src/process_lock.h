@@ -0,0 +1,76 @@
+#ifndef PROCESS_LOCK_H
+#define PROCESS_LOCK_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// Признак жизни процесса в разделяемой памяти. Процесс держит робастный мьютекс
+// всё время работы; если он аварийно завершится, ядро снимет блокировку и
+// следующий trylock вернёт EOWNERDEAD — так другая сторона узнаёт о падении,
+// не дожидаясь ответа, которого уже не будет.
+enum ProcessState : uint32_t {
+    PROCESS_STARTING = 0, // запущен, но ещё не подключился к памяти
+    PROCESS_RUNNING = 1,
+    PROCESS_EXITED = 2
+};
+
+struct ProcessLock {
+    pthread_mutex_t mutex;
+    std::atomic<uint32_t> state;
+    pid_t pid; // заполняет родитель; нужен, пока процесс не подключился
+};
+
+inline bool process_lock_init(ProcessLock& lock) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int rc = pthread_mutex_init(&lock.mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    lock.state.store(PROCESS_STARTING);
+    lock.pid = 0;
+    return rc == 0;
+}
+
+// Вызывается самим процессом при подключении
+inline bool process_lock_acquire(ProcessLock& lock) {
+    int rc = pthread_mutex_lock(&lock.mutex);
+    if (rc == EOWNERDEAD)
+        rc = pthread_mutex_consistent(&lock.mutex);
+    if (rc != 0)
+        return false;
+    lock.state.store(PROCESS_RUNNING);
+    return true;
+}
+
+// Штатное завершение
+inline void process_lock_release(ProcessLock& lock) {
+    lock.state.store(PROCESS_EXITED);
+    pthread_mutex_unlock(&lock.mutex);
+}
+
+// Проверка другой стороной. Пока процесс не подключился, его родитель смотрит
+// на waitpid: иначе упавший до подключения потомок ждали бы вечно.
+inline bool process_alive(ProcessLock& lock) {
+    uint32_t state = lock.state.load();
+    if (state == PROCESS_EXITED)
+        return false;
+    if (state == PROCESS_STARTING)
+        return lock.pid == 0 || waitpid(lock.pid, nullptr, WNOHANG) == 0;
+    int rc = pthread_mutex_trylock(&lock.mutex);
+    if (rc == EBUSY)
+        return true;
+    if (rc == EOWNERDEAD) {
+        pthread_mutex_consistent(&lock.mutex);
+        lock.state.store(PROCESS_EXITED);
+    }
+    if (rc == 0 || rc == EOWNERDEAD)
+        pthread_mutex_unlock(&lock.mutex);
+    return false;
+}
+
+#endif // PROCESS_LOCK_H
@@ -0,0 +1,104 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <cmath>
+#include <cstdint>
+#include "spsc_ring.h"
+#include "pool.h"
+#include "process_lock.h"
+
+const uint32_t RING_CAPACITY = 1024;
+
+enum RequestKind : int32_t {
+    REQUEST_NUMBER = 0,
+    REQUEST_STOP = 1 // дочерний процесс должен завершиться
+};
+
+enum Status : int32_t {
+    STATUS_NEGATIVE = 0,
+    STATUS_COMPOSITE = 1,
+    STATUS_PRIME = 2,
+    STATUS_FILE_ERROR = 3
+};
+
+struct Request {
+    int32_t kind;
+    int32_t number;
+};
+
+struct Response {
+    int32_t number;
+    int32_t status;
+};
+
+// Разделяемая память: очередь запросов от родителя и очередь ответов от ребёнка,
+// для режима пула — общая очередь пакетов и слоты результатов обработчиков,
+// а также признаки жизни родителя и каждого дочернего процесса.
+// Память создаётся через memfd_create и передаётся потомкам дескриптором,
+// поэтому у неё нет имени, а после завершения всех процессов она освобождается сама.
+struct SharedData {
+    SpscRing<Request, RING_CAPACITY> requests;
+    SpscRing<Response, RING_CAPACITY> responses;
+    PoolData pool;
+    ProcessLock parent;
+    ProcessLock children[MAX_WORKERS];
+};
+
+// Инициализация свежего (обнулённого) сегмента родителем. Очереди корректны и
+// в нулевом виде, так что трогаются только признаки жизни участников.
+inline bool init_shared_data(SharedData* data, int children) {
+    bool ok = process_lock_init(data->parent);
+    for (int i = 0; i < children; ++i)
+        ok = ok && process_lock_init(data->children[i]);
+    return ok;
+}
+
+inline const char* status_message(int32_t status) {
+    switch (status) {
+    case STATUS_NEGATIVE:
+        return "Число отрицательное";
+    case STATUS_COMPOSITE:
+        return "Число составное, записано в файл";
+    case STATUS_PRIME:
+        return "Число простое";
+    default:
+        return "Ошибка записи в файл";
+    }
+}
+
+inline bool is_composite(int n) {
+    if (n < 2) return false; // Отрицательное, 0 или 1
+    for (int i = 2; i <= sqrt(n); ++i) {
+        if (n % i == 0) return true; // Составное число
+    }
+    return false; // Простое число
+}
+
+// Цикл обработчика: берёт пакеты до закрытия очереди. Составные числа пакета
+// передаются в write_composites(const int32_t*, uint32_t) одним вызовом.
+// Если писатель погибнет (parent_alive() вернёт false), обработчик тоже завершается.
+template <typename WriteComposites, typename Alive = bool (*)()>
+void run_pool_worker(PoolData& pool, int index, WriteComposites write_composites, Alive parent_alive = always_alive) {
+    WorkerSlot& slot = pool.workers[index];
+    SpinBudget budget;
+    WorkBatch batch;
+    int32_t composites[BATCH_SIZE];
+    while (pool.work.pop(batch, budget, parent_alive)) {
+        uint32_t found = 0;
+        uint64_t negative = 0;
+        for (uint32_t i = 0; i < batch.count; ++i) {
+            if (batch.numbers[i] < 0)
+                ++negative;
+            else if (is_composite(batch.numbers[i]))
+                composites[found++] = batch.numbers[i];
+        }
+        if (found > 0 && !write_composites(composites, found))
+            slot.file_errors.fetch_add(found, std::memory_order_relaxed);
+        slot.processed.fetch_add(batch.count, std::memory_order_relaxed);
+        slot.composite.fetch_add(found, std::memory_order_relaxed);
+        slot.negative.fetch_add(negative, std::memory_order_relaxed);
+        slot.prime.fetch_add(batch.count - found - negative, std::memory_order_relaxed);
+    }
+}
+
+#endif // SHARED_H
@@ -0,0 +1,79 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include "futex.h"
+
+// Кольцевой буфер «один писатель — один читатель» для разделяемой памяти.
+// head двигает только производитель, tail — только потребитель; индексы растут
+// бесконечно (с переполнением uint32), позиция в массиве — index & (Capacity - 1).
+// Поля разных сторон разнесены по кэш-линиям, чтобы не было ложного разделения.
+// Структура не содержит указателей и инициализируется нулями (ftruncate даёт нули).
+template <typename T, uint32_t Capacity>
+struct SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "ёмкость должна быть степенью двойки");
+
+    // Сторона производителя
+    alignas(64) std::atomic<uint32_t> head;
+    uint32_t cached_tail; // последнее увиденное значение tail
+    // Сторона потребителя
+    alignas(64) std::atomic<uint32_t> tail;
+    uint32_t cached_head;
+    // Спящие потребитель (ждёт данных) и производитель (ждёт места)
+    alignas(64) std::atomic<uint32_t> head_waiters;
+    alignas(64) std::atomic<uint32_t> tail_waiters;
+
+    alignas(64) T slots[Capacity];
+
+    bool try_push(const T& value) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - cached_tail == Capacity) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h - cached_tail == Capacity)
+                return false;
+        }
+        slots[h & (Capacity - 1)] = value;
+        head.store(h + 1, std::memory_order_seq_cst);
+        notify(head, head_waiters);
+        return true;
+    }
+
+    bool try_pop(T& value) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (cached_head == t) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (cached_head == t)
+                return false;
+        }
+        value = slots[t & (Capacity - 1)];
+        tail.store(t + 1, std::memory_order_seq_cst);
+        notify(tail, tail_waiters);
+        return true;
+    }
+
+    // Блокирующие операции; возвращают false, если alive() сообщил о гибели второй стороны
+    template <typename Alive = bool (*)()>
+    bool push(const T& value, SpinBudget& budget, Alive alive = always_alive) {
+        while (!try_push(value)) {
+            bool woke = wait_until(tail, tail_waiters, budget, [&] {
+                return head.load(std::memory_order_relaxed) - tail.load() != Capacity;
+            }, alive);
+            if (!woke)
+                return false;
+        }
+        return true;
+    }
+
+    template <typename Alive = bool (*)()>
+    bool pop(T& value, SpinBudget& budget, Alive alive = always_alive) {
+        while (!try_pop(value)) {
+            bool woke = wait_until(head, head_waiters, budget, [&] {
+                return head.load() != tail.load(std::memory_order_relaxed);
+            }, alive);
+            if (!woke)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,681 @@
+// Замеры распределённой системы lab5_7. Управляющий узел здесь — сам бенчмарк:
+// он запускает настоящие ./computing и обменивается с ними теми же сообщениями.
+// Режим depth: цепочка узлов 1 -> 2 -> ... -> N, время ping до узла на каждой глубине.
+// Режим transport: задержка ping до глубины 3 для tcp и ipc и, для сравнения,
+// эхо-поток через inproc в том же процессе.
+// Режим routing: модель дерева из сотен узлов в одном процессе с той же
+// RoutingTable — число сообщений на запрос при рассылке всем детям и по маршрутам
+// для случайных родителей и для автоматического размещения управляющим узлом
+// (по уровням, не больше 8 детей у узла).
+// Режим kv: KvStore против прежнего std::map<std::string, int> на ключах вида
+// keyN при равномерном и ципфовском выборе, плюс сверка результатов.
+// Режим workers: один узел с 0, 1, 2 и 4 потоками-обработчиками — пропускная
+// способность пакетов exec и задержка ping, пока узел занят сканами словаря.
+// Режим spawn: posix_spawn против fork + exec — дерево из 1000 узлов по уровням
+// (по 8 детей) и время от Create до первого ответа на ping для каждого узла,
+// а также цена самого запуска из процесса с большим резидентным объёмом.
+// Режим sim: узлы-потоки в одном процессе поверх inproc (тот же цикл узла, что
+// в computing) — дерево из 10 000 узлов по уровням; время создания, ping до
+// случайных узлов, сообщения heartbeat у корня за интервал и время обнаружения
+// отказа поддерева.
+// Режим client: клиент на сопрограммах (client.h) против цепочки из 3 узлов —
+// 1, 64 и 1024 одновременные сессии запись + чтение, пропускная способность и
+// задержка пары запросов.
+// Запуск из каталога сборки: ./bench depth [глубина] [число ping] [tcp|ipc] |
+//   ./bench transport [число ping] | ./bench routing [узлов] [запросов] | ./bench kv [ключей] [операций] |
+//   ./bench workers [ключей] | ./bench spawn [узлов] [МБ у родителя] | ./bench sim [узлов] [интервал heartbeat, мс] |
+//   ./bench client [пар запросов на сессию]
+#include "lib.h"
+#include "client.h"
+#include "kv_store.h"
+#include "zipf.h"
+#include "hdr_histogram.h"
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <variant>
+
+int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Ожидание ответа command от узла id через прямого ребёнка root; чужие ответы пропускаются
+bool wait_reply(Node& root, com command, int id, int timeout_ms = 5000) {
+    int64_t deadline = now_ns() + (int64_t)timeout_ms * 1000000;
+    while (true) {
+        message m;
+        int from;
+        while ((m = get_mes_from(root.socket, from)).command != None) {
+            if (m.command == Create && m.id == root.id)
+                markReady(root);
+            if (m.command == command && m.id == id)
+                return true;
+        }
+        long left = (long)((deadline - now_ns()) / 1000000);
+        if (left <= 0)
+            return false;
+        zmq_pollitem_t item = {root.socket, 0, ZMQ_POLLIN, 0};
+        zmq_poll(&item, 1, left);
+    }
+}
+
+void print_latency(const char* name, int value, const LatencyHistogram& hist) {
+    std::cout << name << " " << value << ": p50 = " << hist.percentile(50) / 1000.0
+              << " мкс, p99 = " << hist.percentile(99) / 1000.0 << " мкс, max = " << hist.max() / 1000.0
+              << " мкс" << std::endl;
+}
+
+// Эхо через пару DEALER/ROUTER inproc: нижняя граница для узлов-потоков
+void bench_inproc(int pings) {
+    std::string address;
+    setTransport(TransportInproc);
+    void* router = childrenSocket(0, address);
+    std::thread echo([&] {
+        Node node = createNode(1, address);
+        for (int i = 0; i < pings; ++i) {
+            zmq_pollitem_t item = {node.socket, 0, ZMQ_POLLIN, 0};
+            zmq_poll(&item, 1, -1);
+            send_mes(node, get_mes(node));
+        }
+        zmq_close(node.socket);
+    });
+    Node child;
+    child.id = 1;
+    child.socket = router;
+    child.via_router = true;
+    child.ready = true;
+    LatencyHistogram hist;
+    for (int i = 0; i < pings; ++i) {
+        int64_t start = now_ns();
+        send_mes(child, message(Ping, 1, 0));
+        // ROUTER_MANDATORY: пока поток не подключился, отправка не проходит
+        if (!wait_reply(child, Ping, 1, 100)) {
+            --i;
+            continue;
+        }
+        hist.record(now_ns() - start);
+    }
+    echo.join();
+    print_latency("inproc, глубина", 1, hist);
+}
+
+int bench_depth(int max_depth, int pings) {
+    Node root = createProcess(-1, 1);
+    if (!wait_reply(root, Create, 1)) {
+        std::cerr << "Узел 1 не создан" << std::endl;
+        return 1;
+    }
+    for (int id = 2; id <= max_depth; ++id) {
+        send_mes(root, message(Create, id - 1, id));
+        if (!wait_reply(root, Create, id)) {
+            std::cerr << "Узел " << id << " не создан" << std::endl;
+            return 1;
+        }
+    }
+    for (int depth = 1; depth <= max_depth; ++depth) {
+        LatencyHistogram hist;
+        for (int i = 0; i < pings; ++i) {
+            int64_t start = now_ns();
+            send_mes(root, message(Ping, depth, 0));
+            if (!wait_reply(root, Ping, depth)) {
+                std::cerr << "Узел " << depth << " не отвечает" << std::endl;
+                return 1;
+            }
+            hist.record(now_ns() - start);
+        }
+        print_latency("Глубина", depth, hist);
+    }
+    return 0;
+}
+
+// Узел модели: индекс в векторе совпадает с id, 0 — управляющий узел
+struct SimNode {
+    Node node;
+    SimNode* parent = nullptr;
+    std::vector<SimNode*> children;
+    RoutingTable routes;
+    int depth = 0;
+};
+
+// Число сообщений, которые отправит поддерево at, доставляя запрос к target
+int sim_deliver(std::vector<SimNode>& sims, SimNode& at, int target, bool routed) {
+    if (at.node.id == target)
+        return 0;
+    Node* via = routed ? at.routes.find(target) : nullptr;
+    if (via)
+        return 1 + sim_deliver(sims, sims[via->id], target, routed);
+    int sent = 0;
+    for (SimNode* child : at.children)
+        sent += 1 + sim_deliver(sims, *child, target, routed);
+    return sent;
+}
+
+void bench_routing(int nodes, int requests) {
+    std::mt19937 rng(42);
+    const int AUTO_FANOUT = 8;
+    for (int variant = 0; variant < 3; ++variant) {
+        bool routed = variant > 0;
+        bool placed = variant == 2;
+        std::vector<SimNode> sims(nodes + 1);
+        for (int id = 0; id <= nodes; ++id)
+            sims[id].node.id = id;
+        uint64_t create_messages = 0;
+        for (int id = 1; id <= nodes; ++id) {
+            SimNode& parent = sims[placed ? (id - 1) / AUTO_FANOUT : rng() % id];
+            SimNode& child = sims[id];
+            // Запрос Create к родителю и подтверждение, поднимающееся до корня
+            create_messages += sim_deliver(sims, sims[0], parent.node.id, routed) + parent.depth + 1;
+            child.parent = &parent;
+            child.depth = parent.depth + 1;
+            parent.children.push_back(&child);
+            for (SimNode* hop = &child; hop->parent; hop = hop->parent)
+                hop->parent->routes.add(id, &hop->node);
+        }
+        uint64_t messages = 0, max_messages = 0;
+        for (int i = 0; i < requests; ++i) {
+            SimNode& target = sims[1 + rng() % nodes];
+            uint64_t sent = sim_deliver(sims, sims[0], target.node.id, routed) + target.depth;
+            messages += sent;
+            max_messages = std::max(max_messages, sent);
+        }
+        std::cout << (placed ? "Размещение по уровням" : routed ? "По маршрутам" : "Всем детям") << ": узлов " << nodes
+                  << ", сообщений на запрос " << (double)messages / requests << " (max " << max_messages
+                  << "), на создание узла " << (double)create_messages / nodes << std::endl;
+    }
+}
+
+// Время на операцию в наносекундах
+template <typename F>
+double ns_per_op(size_t count, F f) {
+    int64_t start = now_ns();
+    for (size_t i = 0; i < count; ++i)
+        f(i);
+    return (double)(now_ns() - start) / count;
+}
+
+// Случайные операции над KvStore и std::map; число расхождений
+size_t kv_verify(size_t ops) {
+    std::mt19937 rng(7);
+    KvStore store;
+    std::map<std::string, std::variant<int64_t, std::string>> model;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < ops; ++i) {
+        std::string key = "k" + std::to_string(rng() % 5000);
+        switch (rng() % 4) {
+        case 0:
+            store.put(key, (int64_t)i);
+            model[key] = (int64_t)i;
+            break;
+        case 1: {
+            std::string blob(rng() % 300, 'a' + i % 26);
+            store.put_blob(key, blob);
+            model[key] = blob;
+            break;
+        }
+        case 2:
+            mismatches += store.erase(key) != (model.erase(key) == 1);
+            break;
+        default: {
+            KvStore::Value value;
+            bool found = store.get(key, value);
+            auto it = model.find(key);
+            if (found != (it != model.end()))
+                ++mismatches;
+            else if (found && value.is_blob)
+                mismatches += !std::holds_alternative<std::string>(it->second)
+                              || std::get<std::string>(it->second) != value.blob;
+            else if (found)
+                mismatches += !std::holds_alternative<int64_t>(it->second)
+                              || std::get<int64_t>(it->second) != value.number;
+        }
+        }
+    }
+    mismatches += store.size() != model.size();
+    std::vector<KvStore::Entry> prefix = store.scan_prefix("k12");
+    size_t expected = 0;
+    for (auto it = model.lower_bound("k12"); it != model.end() && it->first.compare(0, 3, "k12") == 0; ++it)
+        ++expected;
+    mismatches += prefix.size() != expected;
+    return mismatches;
+}
+
+void bench_kv(size_t keys, size_t ops) {
+    std::vector<std::string> names(keys);
+    for (size_t i = 0; i < keys; ++i)
+        names[i] = "key" + std::to_string(i);
+    std::mt19937 rng(42);
+    ZipfGenerator zipf(keys, 0.99);
+    std::vector<size_t> uniform_order(ops), zipf_order(ops);
+    for (size_t i = 0; i < ops; ++i) {
+        uniform_order[i] = rng() % keys;
+        zipf_order[i] = zipf(rng);
+    }
+    // Ключи приходят из сообщения как string_view, как в computing
+    std::vector<std::string_view> views(names.begin(), names.end());
+
+    // Прежняя схема: ключ копируется в std::string, find и затем operator[]
+    std::map<std::string, int> dict;
+    int64_t sum = 0;
+    double map_put = ns_per_op(keys, [&](size_t i) { dict[std::string(views[i])] = (int)i; });
+    auto map_find = [&](const std::vector<size_t>& order) {
+        return ns_per_op(ops, [&](size_t i) {
+            std::string key(views[order[i]]);
+            if (dict.find(key) != dict.end())
+                sum += dict[key];
+        });
+    };
+    double map_uniform = map_find(uniform_order), map_zipf = map_find(zipf_order);
+
+    KvStore store;
+    double kv_put = ns_per_op(keys, [&](size_t i) { store.put(views[i], (int64_t)i); });
+    auto kv_find = [&](const std::vector<size_t>& order) {
+        return ns_per_op(ops, [&](size_t i) {
+            KvStore::Value value;
+            if (store.get(views[order[i]], value))
+                sum += value.number;
+        });
+    };
+    double kv_uniform = kv_find(uniform_order), kv_zipf = kv_find(zipf_order);
+    std::vector<std::string> missing(keys);
+    for (size_t i = 0; i < keys; ++i)
+        missing[i] = "miss" + std::to_string(i);
+    double kv_miss = ns_per_op(ops, [&](size_t i) {
+        KvStore::Value value;
+        sum += store.get(missing[uniform_order[i]], value);
+    });
+
+    std::cout << "Ключей " << keys << ", операций " << ops << " (нс на операцию)" << std::endl;
+    std::cout << "std::map: вставка " << map_put << ", поиск равномерно " << map_uniform << ", по Ципфу "
+              << map_zipf << std::endl;
+    std::cout << "KvStore:  вставка " << kv_put << ", поиск равномерно " << kv_uniform << ", по Ципфу " << kv_zipf
+              << ", промах " << kv_miss << std::endl;
+    std::cout << "Сверка с std::map: расхождений " << kv_verify(ops) << " (контрольная сумма " << sum % 10 << ")"
+              << std::endl;
+}
+
+// Пакеты exec к узлу 1 с окном window неотвеченных; возвращает операций в секунду
+double pump_batches(Node& root, size_t keys, bool put, size_t window) {
+    const size_t per_batch = 256;
+    size_t batches = (keys + per_batch - 1) / per_batch, sent = 0, received = 0;
+    int64_t start = now_ns();
+    while (received < batches) {
+        while (sent < batches && sent - received < window) {
+            message m(Batch, 1, 0);
+            for (size_t i = sent * per_batch; i < keys && i < (sent + 1) * per_batch; ++i, ++m.num)
+                batch_append(m.value, put ? ExecAdd : ExecFnd, (int64_t)i, "key" + std::to_string(i));
+            send_mes(root, m);
+            ++sent;
+        }
+        if (!wait_reply(root, Batch, 1))
+            return 0;
+        ++received;
+    }
+    return keys / ((now_ns() - start) / 1e9);
+}
+
+int bench_workers(int workers, size_t keys) {
+    setNodeWorkers(workers);
+    Node root = createProcess(-1, 1);
+    if (!wait_reply(root, Create, 1)) {
+        std::cerr << "Узел 1 не создан" << std::endl;
+        return 1;
+    }
+    double put = pump_batches(root, keys, true, 16);
+    double find = pump_batches(root, keys, false, 16);
+    // Скан с префиксом всех ключей проходит весь словарь, ping идёт следом за ним
+    LatencyHistogram hist;
+    for (int i = 0; i < 50; ++i) {
+        message scan(ExecScan, 1, 10, "key");
+        send_mes(root, scan);
+        int64_t start = now_ns();
+        send_mes(root, message(Ping, 1, 0));
+        bool answered = wait_reply(root, Ping, 1);
+        hist.record(now_ns() - start);
+        if (!answered || !wait_reply(root, ExecScan, 1)) {
+            std::cerr << "Узел 1 не отвечает" << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "Обработчиков " << workers << ": запись " << (int64_t)put << " оп/с, поиск " << (int64_t)find
+              << " оп/с; ping за сканом p50 = " << hist.percentile(50) / 1000.0 << " мкс, max = "
+              << hist.max() / 1000.0 << " мкс" << std::endl;
+    return 0;
+}
+
+// Дерево из nodes узлов по уровням: у узла k > 1 родитель (k - 2) / 8 + 1.
+// Узлы создаются по одному, время — от отправки Create до ответа на первый ping
+int bench_spawn_tree(SpawnMode mode, int nodes) {
+    setSpawnMode(mode);
+    LatencyHistogram hist;
+    int64_t total_start = now_ns();
+    Node root;
+    for (int id = 1; id <= nodes; ++id) {
+        int64_t start = now_ns();
+        if (id == 1)
+            root = createProcess(-1, 1);
+        else
+            send_mes(root, message(Create, (id - 2) / 8 + 1, id));
+        bool created = wait_reply(root, Create, id);
+        if (created)
+            send_mes(root, message(Ping, id, 0));
+        if (!created || !wait_reply(root, Ping, id)) {
+            std::cerr << "Узел " << id << " не отвечает" << std::endl;
+            return 1;
+        }
+        hist.record(now_ns() - start);
+    }
+    std::cout << (mode == SpawnFork ? "fork + exec" : "posix_spawn") << ", " << nodes << " узлов за "
+              << (now_ns() - total_start) / 1000000 << " мс; до первого ping p50 = " << hist.percentile(50) / 1000.0
+              << " мкс, p99 = " << hist.percentile(99) / 1000.0 << " мкс, max = " << hist.max() / 1000.0 << " мкс"
+              << std::endl;
+    return 0;
+}
+
+// Цена createProcess у родителя с ballast_mb мегабайт резидентной памяти:
+// fork копирует таблицы страниц, posix_spawn — нет
+int bench_spawn_cost(SpawnMode mode, size_t ballast_mb) {
+    setSpawnMode(mode);
+    std::vector<char> ballast(ballast_mb << 20, 1);
+    LatencyHistogram hist;
+    const int children = 20;
+    Node any;
+    for (int id = 1; id <= children; ++id) {
+        int64_t start = now_ns();
+        Node child = createProcess(-1, id);
+        hist.record(now_ns() - start);
+        if (id == 1)
+            any = child;
+    }
+    // Подтверждения приходят в любом порядке, поэтому ждём их по счёту
+    int created = 0;
+    while (created < children) {
+        zmq_pollitem_t item = {any.socket, 0, ZMQ_POLLIN, 0};
+        if (zmq_poll(&item, 1, 5000) <= 0) {
+            std::cerr << "Создано узлов " << created << " из " << children << std::endl;
+            return 1;
+        }
+        message m;
+        int from;
+        while ((m = get_mes_from(any.socket, from)).command != None)
+            created += m.command == Create;
+    }
+    std::cout << (mode == SpawnFork ? "fork + exec" : "posix_spawn") << ", родитель " << ballast_mb
+              << " МБ: createProcess p50 = " << hist.percentile(50) / 1000.0 << " мкс, max = " << hist.max() / 1000.0
+              << " мкс (контроль " << (int)ballast[ballast.size() / 2] << ")" << std::endl;
+    return 0;
+}
+
+// Родитель узла k > 1 в дереве по уровням с 8 детьми у узла
+int sim_parent(int id) {
+    return (id - 2) / 8 + 1;
+}
+
+int bench_sim(int nodes, int interval_ms) {
+    setTransport(TransportInproc);
+    setNodeWorkers(0);
+    ChildTable children;
+    Node& root = *children.add(createProcess(-1, 1));
+    std::vector<bool> created(nodes + 1, false);
+    std::vector<int> depth(nodes + 1, 0);
+    int acked = 0;
+    // Все ответы идут через корень; подтверждения Create считаются здесь
+    auto drain = [&](const std::function<void(message&)>& on_reply, int timeout_ms) {
+        zmq_pollitem_t item = {root.socket, 0, ZMQ_POLLIN, 0};
+        if (zmq_poll(&item, 1, timeout_ms) <= 0)
+            return false;
+        message m;
+        int from;
+        while ((m = get_mes_from(root.socket, from)).command != None) {
+            returnCredit(root, m.command, m.corr);
+            if (m.command == Create && m.id >= 1 && m.id <= nodes && !created[m.id]) {
+                if (m.id == 1)
+                    markReady(root);
+                created[m.id] = true;
+                ++acked;
+            }
+            on_reply(m);
+        }
+        flushOutbox(root);
+        return true;
+    };
+    auto ignore = [](message&) {};
+
+    // Узел создаётся, как только подтверждён его родитель
+    int64_t start = now_ns();
+    int next = 2;
+    while (acked < nodes) {
+        for (; next <= nodes && created[sim_parent(next)]; ++next) {
+            depth[next] = depth[sim_parent(next)] + 1;
+            send_mes(root, message(Create, sim_parent(next), next));
+        }
+        if (!drain(ignore, 5000)) {
+            std::cerr << "Создано узлов " << acked << " из " << nodes << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "Узлов " << nodes << " (глубина " << depth[nodes] << "): создание " << (now_ns() - start) / 1000000
+              << " мс" << std::endl;
+
+    // Ping до случайных узлов: по одному — задержка, окном 64 — пропускная способность
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> pick(1, nodes);
+    LatencyHistogram ping;
+    for (int i = 0; i < 2000; ++i) {
+        int target = pick(rng);
+        int64_t sent = now_ns();
+        bool answered = false;
+        send_mes(root, message(Ping, target, 0));
+        while (!answered)
+            if (!drain([&](message& m) { answered |= m.command == Ping && m.id == target; }, 5000))
+                return 1;
+        ping.record(now_ns() - sent);
+    }
+    print_latency("Ping до случайного узла, запросов", 2000, ping);
+    const int pings = 100000;
+    int sent = 0, answered = 0;
+    start = now_ns();
+    while (answered < pings) {
+        for (; sent < pings && sent - answered < 64; ++sent)
+            send_mes(root, message(Ping, pick(rng), 0));
+        if (!drain([&](message& m) { answered += m.command == Ping; }, 5000))
+            return 1;
+    }
+    std::cout << "Ping окном 64: " << (int64_t)(pings / ((now_ns() - start) / 1e9)) << " в секунду" << std::endl;
+
+    // Heartbeat: к корню приходит одна сводка за интервал на всё дерево
+    auto interval = std::chrono::milliseconds(interval_ms);
+    std::streambuf* out = std::cout.rdbuf();
+    handle_heartbeat_command(children, interval_ms);
+    int summaries = 0;
+    size_t alive_max = 0;
+    auto run_for = [&](std::chrono::milliseconds period, const std::function<void(int)>& on_missed) {
+        auto until = std::chrono::steady_clock::now() + period;
+        while (std::chrono::steady_clock::now() < until) {
+            check_beats(on_missed);
+            drain([&](message& m) {
+                if (m.command != HeartBeat)
+                    return;
+                ++summaries;
+                size_t alive = 0;
+                handle_beat_summary(m.value, m.id, [&](int) { ++alive; });
+                alive_max = std::max(alive_max, alive);
+            }, 10);
+        }
+    };
+    // Пока сводки не заполнились, узлы «появляются» — их сообщения не считаются
+    std::cout.rdbuf(nullptr);
+    run_for(6 * interval, [](int) {});
+    std::cout.rdbuf(out);
+    std::cout.clear();
+    summaries = 0;
+    const int periods = 10;
+    int missed_before = 0;
+    run_for(periods * interval, [&](int) { ++missed_before; });
+    std::cout << "Heartbeat " << interval_ms << " мс: сводок у корня " << summaries / (double)periods
+              << " за интервал, ложных отказов " << missed_before << std::endl;
+    print_beat_stats(std::cout);
+
+    // Отказ: останавливается узел третьего уровня вместе с поддеревом
+    int failed = std::min(nodes, 74);
+    std::vector<bool> in_subtree(nodes + 1, false);
+    int subtree = 0;
+    for (int id = failed; id <= nodes; ++id) {
+        in_subtree[id] = id == failed || (id > 1 && in_subtree[sim_parent(id)]);
+        subtree += in_subtree[id];
+    }
+    int detected = 0, wrong = 0;
+    int64_t first = 0, last = 0;
+    start = now_ns();
+    stopNodeThread(failed);
+    std::cout.rdbuf(nullptr);
+    auto give_up = std::chrono::steady_clock::now() + 20 * interval;
+    while (detected < subtree && std::chrono::steady_clock::now() < give_up) {
+        run_for(interval / 10, [&](int id) {
+            if (id > nodes || !in_subtree[id]) {
+                ++wrong;
+                return;
+            }
+            last = now_ns() - start;
+            if (detected++ == 0)
+                first = last;
+        });
+    }
+    std::cout.rdbuf(out);
+    std::cout.clear();
+    std::cout << "Отказ узла " << failed << " (поддерево " << subtree << "): обнаружено " << detected << " через "
+              << first / 1000000 << "-" << last / 1000000 << " мс, ложных " << wrong << std::endl;
+    return detected == subtree ? 0 : 1;
+}
+
+// Цепочка 1 -> 2 -> ... -> depth
+Task<bool> client_chain(Cluster& cluster, int depth) {
+    for (int id = 1; id <= depth; ++id) {
+        Reply created = co_await cluster.create(id, id == 1 ? -1 : id - 1);
+        if (!created.ok()) {
+            std::cerr << "Узел " << id << ": " << replyStatusName(created.status) << std::endl;
+            co_return false;
+        }
+    }
+    co_return true;
+}
+
+// Сессия: запись и чтение своих ключей на узле id, задержка пары — в hist
+Task<> client_session(Cluster& cluster, int id, int session, int pairs, LatencyHistogram& hist, int& errors) {
+    for (int i = 0; i < pairs; ++i) {
+        std::string key = "s" + std::to_string(session) + "k" + std::to_string(i);
+        int64_t start = now_ns();
+        Reply added = co_await cluster.exec_add(id, key, i);
+        Reply found = co_await cluster.exec_find(id, key);
+        hist.record(now_ns() - start);
+        if (!added.ok() || !found.ok() || found.num != i)
+            ++errors;
+    }
+}
+
+int bench_client(int pairs) {
+    Cluster cluster;
+    const int depth = 3;
+    if (!cluster.run(client_chain(cluster, depth)))
+        return 1;
+    for (int sessions : {1, 64, 1024}) {
+        LatencyHistogram hist;
+        int errors = 0;
+        int64_t start = now_ns();
+        for (int session = 0; session < sessions; ++session)
+            cluster.spawn(client_session(cluster, depth, session, pairs, hist, errors));
+        cluster.run();
+        double seconds = (now_ns() - start) / 1e9;
+        std::cout << "Сессий " << sessions << ": " << (int64_t)(2.0 * sessions * pairs / seconds)
+                  << " запросов/с, пара запросов p50 = " << hist.percentile(50) / 1000.0 << " мкс, p99 = "
+                  << hist.percentile(99) / 1000.0 << " мкс, ошибок " << errors << std::endl;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "depth";
+    if (mode == "depth") {
+        int max_depth = argc > 2 ? atoi(argv[2]) : 8;
+        int pings = argc > 3 ? atoi(argv[3]) : 1000;
+        Transport transport = TransportTcp;
+        if (argc > 4 && !parseTransport(argv[4], transport)) {
+            std::cerr << "Неизвестный транспорт " << argv[4] << std::endl;
+            return 1;
+        }
+        setTransport(transport);
+        return bench_depth(max_depth, pings);
+    }
+    if (mode == "transport") {
+        // Каждый транспорт — в отдельном процессе: ROUTER создаётся один раз на процесс
+        int pings = argc > 2 ? atoi(argv[2]) : 1000;
+        for (const char* name : {"tcp", "ipc"}) {
+            std::cout << name << ":" << std::endl;
+            pid_t pid = fork();
+            if (pid == 0) {
+                setTransport(name == std::string("tcp") ? TransportTcp : TransportIpc);
+                _exit(bench_depth(3, pings));
+            }
+            waitpid(pid, nullptr, 0);
+        }
+        bench_inproc(pings);
+        return 0;
+    }
+    if (mode == "routing") {
+        int nodes = argc > 2 ? atoi(argv[2]) : 300;
+        int requests = argc > 3 ? atoi(argv[3]) : 10000;
+        bench_routing(nodes, requests);
+        return 0;
+    }
+    if (mode == "kv") {
+        size_t keys = argc > 2 ? atol(argv[2]) : 100000;
+        size_t ops = argc > 3 ? atol(argv[3]) : 1000000;
+        bench_kv(keys, ops);
+        return 0;
+    }
+    if (mode == "workers") {
+        // Каждая конфигурация — в отдельном процессе: узел 1 создаётся заново
+        size_t keys = argc > 2 ? atol(argv[2]) : 200000;
+        for (int workers : {0, 1, 2, 4}) {
+            pid_t pid = fork();
+            if (pid == 0)
+                _exit(bench_workers(workers, keys));
+            waitpid(pid, nullptr, 0);
+        }
+        return 0;
+    }
+    if (mode == "sim") {
+        // Потоки узлов не завершаются: выход без деструкторов статических объектов
+        int nodes = argc > 2 ? atoi(argv[2]) : 10000;
+        int interval_ms = argc > 3 ? atoi(argv[3]) : 1000;
+        int code = bench_sim(nodes, interval_ms);
+        std::cout.flush();
+        _exit(code);
+    }
+    if (mode == "client")
+        return bench_client(argc > 2 ? atoi(argv[2]) : 200);
+    if (mode == "spawn") {
+        // Каждый замер — в отдельном процессе: с его выходом завершается и всё дерево
+        int nodes = argc > 2 ? atoi(argv[2]) : 1000;
+        size_t ballast_mb = argc > 3 ? atol(argv[3]) : 256;
+        for (SpawnMode spawn : {SpawnPosix, SpawnFork}) {
+            pid_t pid = fork();
+            if (pid == 0)
+                _exit(bench_spawn_tree(spawn, nodes));
+            waitpid(pid, nullptr, 0);
+        }
+        for (SpawnMode spawn : {SpawnPosix, SpawnFork}) {
+            pid_t pid = fork();
+            if (pid == 0)
+                _exit(bench_spawn_cost(spawn, ballast_mb));
+            waitpid(pid, nullptr, 0);
+        }
+        return 0;
+    }
+    std::cerr << "Usage: " << argv[0] << " depth [глубина] [число ping] [tcp|ipc] | transport [число ping]"
+              << " | routing [узлов] [запросов] | kv [ключей] [операций] | workers [ключей]"
+              << " | spawn [узлов] [МБ у родителя] | sim [узлов] [интервал heartbeat, мс]"
+              << " | client [пар запросов на сессию]" << std::endl;
+    return 1;
+}
@@ -0,0 +1,287 @@
+#include "client.h"
+#include <errno.h>
+
+const char* replyStatusName(Reply::Status status)
+{
+    static const char* names[] = {"ok", "not found", "timeout", "unavailable", "busy"};
+    return names[status];
+}
+
+void RequestAwaiter::await_suspend(std::coroutine_handle<> waiter)
+{
+    waiter_ = waiter;
+    cluster_.submit(*this);
+}
+
+Cluster::Cluster(std::chrono::milliseconds timeout) : timeout_(timeout)
+{
+    // SIGCHLD блокируется до появления потоков ZeroMQ
+    childExitFd();
+}
+
+RequestAwaiter Cluster::create(int id, int parent)
+{
+    return RequestAwaiter(*this, message(Create, parent, id));
+}
+
+RequestAwaiter Cluster::ping(int id)
+{
+    return RequestAwaiter(*this, message(Ping, id, 0));
+}
+
+RequestAwaiter Cluster::exec_add(int id, std::string key, int64_t value)
+{
+    return RequestAwaiter(*this, message(ExecAdd, id, value, key));
+}
+
+RequestAwaiter Cluster::exec_add_blob(int id, std::string key, std::string blob)
+{
+    message m(ExecAdd, id, 0, key);
+    m.flags = WIRE_BLOB;
+    m.value = std::move(blob);
+    return RequestAwaiter(*this, std::move(m));
+}
+
+RequestAwaiter Cluster::exec_find(int id, std::string key)
+{
+    return RequestAwaiter(*this, message(ExecFnd, id, -1, key));
+}
+
+RequestAwaiter Cluster::exec_del(int id, std::string key)
+{
+    return RequestAwaiter(*this, message(ExecDel, id, 0, key));
+}
+
+RequestAwaiter Cluster::scan(int id, std::string prefix, int64_t limit)
+{
+    return RequestAwaiter(*this, message(ExecScan, id, limit, prefix));
+}
+
+RequestAwaiter Cluster::stats(int id)
+{
+    return RequestAwaiter(*this, message(Stats, id, 0));
+}
+
+// Задача запускается обёрткой, которая сама уничтожает свой кадр по завершении
+namespace {
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::abort(); }
+    };
+};
+
+Detached runDetached(Task<> task, size_t& tasks)
+{
+    ++tasks;
+    co_await task;
+    --tasks;
+}
+} // namespace
+
+void Cluster::spawn(Task<> task)
+{
+    runDetached(std::move(task), tasks_);
+}
+
+void Cluster::run()
+{
+    while (tasks_ > 0)
+        poll(-1);
+}
+
+void Cluster::failNow(RequestAwaiter& awaiter, Reply::Status status)
+{
+    awaiter.reply_.status = status;
+    failed_now_.push_back(&awaiter);
+}
+
+void Cluster::submit(RequestAwaiter& awaiter)
+{
+    message& m = awaiter.request_;
+    m.corr = next_corr_++;
+    int target = m.command == Create ? (int)m.num : m.id;
+    pending_[m.corr] = {&awaiter, target};
+    deadlines_.schedule(TimerWheel<uint64_t>::Clock::now() + timeout_, m.corr);
+    if (m.command == Create)
+    {
+        creating_[target] = m.corr;
+        if (m.id == -1)
+        {
+            // Прямой ребёнок: подтверждение придёт от него самого при подключении
+            Node* child = children_.add(createProcess(-1, target));
+            router_ = child->socket;
+            routes_.add(target, child);
+            return;
+        }
+        if (Node* via = routes_.find(m.id))
+            via->subtree_creates.push_back(m);
+    }
+    if (!routes_.find(m.id))
+    {
+        pending_.erase(m.corr);
+        creating_.erase(target);
+        failNow(awaiter, Reply::Unavailable);
+        return;
+    }
+    SendResult result = forward(routes_, m.id, m);
+    if (result == SendBusy || result == SendNoRoute)
+    {
+        pending_.erase(m.corr);
+        creating_.erase(target);
+        failNow(awaiter, result == SendBusy ? Reply::Busy : Reply::Unavailable);
+    }
+}
+
+// Запрос завершён: результат — в ожидающего, затем его сопрограмма продолжается.
+// Запись удаляется до возобновления: сопрограмма может сразу отправить следующий
+void Cluster::complete(uint64_t corr, Reply::Status status, message* reply)
+{
+    auto it = pending_.find(corr);
+    if (it == pending_.end())
+        return;
+    RequestAwaiter* awaiter = it->second.awaiter;
+    pending_.erase(it);
+    // Без ответа (срок, упавший узел) кредит у прямого ребёнка возвращается здесь
+    if (Node* via = routes_.find(awaiter->request_.id))
+        releaseCredit(*via, corr);
+    Reply& result = awaiter->reply_;
+    result.status = status;
+    if (reply)
+    {
+        result.num = reply->num;
+        result.is_blob = reply->flags & WIRE_BLOB;
+        result.value = std::move(reply->value);
+    }
+    awaiter->waiter_.resume();
+}
+
+// Узел упал: его запросы завершаются сразу, не дожидаясь срока
+void Cluster::failTarget(int id)
+{
+    std::vector<uint64_t> failed;
+    for (const auto& [corr, pending] : pending_)
+    {
+        if (pending.target == id)
+            failed.push_back(corr);
+    }
+    for (uint64_t corr : failed)
+        complete(corr, Reply::Unavailable);
+}
+
+void Cluster::handleReply(message& m, Node* from)
+{
+    switch (m.command)
+    {
+    case Create:
+    {
+        // Подтверждение шлёт сам новый узел, без идентификатора запроса
+        if (m.id == from->id)
+            markReady(*from);
+        routes_.add(m.id, from);
+        auto it = creating_.find(m.id);
+        if (it == creating_.end())
+            break;
+        uint64_t corr = it->second;
+        creating_.erase(it);
+        complete(corr, Reply::Ok, &m);
+        break;
+    }
+    case ExecErr:
+        complete(m.corr, Reply::NotFound, &m);
+        break;
+    case Busy:
+        complete(m.corr, Reply::Busy);
+        break;
+    case Unavailable:
+        // С corr — отказ по одному запросу, без него — узел id упал
+        if (m.corr)
+            complete(m.corr, Reply::Unavailable);
+        else
+            failTarget(m.id);
+        break;
+    case HeartBeat:
+        break;
+    default:
+        complete(m.corr, Reply::Ok, &m);
+        break;
+    }
+}
+
+void Cluster::poll(long timeout_ms)
+{
+    auto current = TimerWheel<uint64_t>::Clock::now();
+    long next_deadline = deadlines_.msUntilNext(current);
+    if (next_deadline >= 0 && (timeout_ms < 0 || next_deadline < timeout_ms))
+        timeout_ms = next_deadline;
+    // Отложенное в outbox детей досылается с повтором через 1 мс
+    if (flushOutboxes(children_) && (timeout_ms < 0 || timeout_ms > 1))
+        timeout_ms = 1;
+    if (!failed_now_.empty())
+        timeout_ms = 0;
+    zmq_pollitem_t items[2] = {{nullptr, childExitFd(), ZMQ_POLLIN, 0}};
+    int count = 1;
+    if (router_)
+        items[count++] = {router_, 0, ZMQ_POLLIN, 0};
+    if (zmq_poll(items, count, timeout_ms) == -1 && errno != EINTR)
+        return;
+
+    // Ответы сначала принимаются целиком, затем завершаются: возобновлённая
+    // сопрограмма сразу шлёт новый запрос, и приём иначе мог не закончиться.
+    // Упавшие узлы и истёкшие сроки тоже собираются до завершения:
+    // продолжившись, сопрограмма может добавить ребёнка или срок
+    std::vector<std::pair<message, Node*>> replies;
+    if (router_ && (items[1].revents & ZMQ_POLLIN))
+    {
+        message m;
+        int from;
+        auto received = std::chrono::steady_clock::now();
+        while ((m = get_mes_from(router_, from)).command != None)
+        {
+            Node* child = children_.find(from);
+            if (!child)
+                continue;
+            child->last_seen = received;
+            returnCredit(*child, m.command, m.corr);
+            replies.emplace_back(std::move(m), child);
+        }
+    }
+    for (auto& [reply, child] : replies)
+        handleReply(reply, child);
+    std::vector<int> down;
+    std::vector<uint64_t> lost_requests;
+    if (items[0].revents & ZMQ_POLLIN)
+    {
+        handleChildExits(children_, heartbeatInterval(), [&](Node& child, const std::vector<uint64_t>& lost) {
+            std::vector<int> ids = routes_.reachableVia(&child);
+            down.insert(down.end(), ids.begin(), ids.end());
+            lost_requests.insert(lost_requests.end(), lost.begin(), lost.end());
+        });
+    }
+    for (int id : down)
+        failTarget(id);
+    for (uint64_t corr : lost_requests)
+        complete(corr, Reply::Unavailable);
+    std::vector<uint64_t> expired;
+    deadlines_.expire(TimerWheel<uint64_t>::Clock::now(), [&](uint64_t corr) { expired.push_back(corr); });
+    for (uint64_t corr : expired)
+    {
+        auto it = pending_.find(corr);
+        if (it == pending_.end())
+            continue;
+        // Запись создания снимается вместе с запросом
+        auto creating = creating_.find(it->second.target);
+        if (creating != creating_.end() && creating->second == corr)
+            creating_.erase(creating);
+        complete(corr, Reply::Timeout);
+    }
+    // Отказы, известные при отправке; новые, появившиеся при возобновлении, —
+    // до следующего poll()
+    std::vector<RequestAwaiter*> failed;
+    failed.swap(failed_now_);
+    for (RequestAwaiter* awaiter : failed)
+        awaiter->waiter_.resume();
+}
@@ -0,0 +1,192 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "lib.h"
+#include "timer_wheel.h"
+#include <coroutine>
+#include <cstdlib>
+#include <optional>
+#include <type_traits>
+
+// Клиент дерева узлов на сопрограммах C++20:
+//
+//     Task<> session(Cluster& cluster) {
+//         co_await cluster.create(1);
+//         Reply found = co_await cluster.exec_find(1, "key");
+//         if (found.status == Reply::Timeout) ...
+//     }
+//     cluster.run(session(cluster));
+//
+// Цикл событий — тот же zmq_poll по ROUTER детей, что у управляющего узла.
+// Ожидающий запрос — это подвешенная сопрограмма в таблице по идентификатору
+// запроса и срок в колесе таймеров, поэтому тысячи одновременных запросов не
+// требуют ни потоков, ни перебора при сопоставлении ответов.
+
+// Итог запроса
+struct Reply {
+    enum Status : uint8_t {
+        Ok,
+        NotFound,    // exec_find: ключа нет
+        Timeout,     // ответа нет за срок
+        Unavailable, // узел упал или его нет в дереве
+        Busy         // отвергнут перегруженным узлом на пути (FlowLimits)
+    };
+    Status status = Timeout;
+    int64_t num = 0;     // значение exec_find, pid для create, число записей для scan
+    bool is_blob = false;
+    std::string value;   // блоб, записи скана (wire.h) или строки stats
+    bool ok() const { return status == Ok; }
+};
+
+const char* replyStatusName(Reply::Status status);
+
+// Ленивая сопрограмма: начинает работу при co_await и по завершении
+// возобновляет ожидающего. Исключения в лабораторной не используются, поэтому
+// необработанное завершает процесс.
+template <typename T = void>
+class Task {
+    struct PromiseBase {
+        std::coroutine_handle<> continuation;
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct Final {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> done) noexcept {
+                    (void)done;
+                    return continuation ? continuation : std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+                std::coroutine_handle<> continuation;
+            };
+            return Final{continuation};
+        }
+        void unhandled_exception() { std::abort(); }
+    };
+    struct ValuePromise : PromiseBase {
+        T value{};
+        void return_value(T result) { value = std::move(result); }
+    };
+    struct VoidPromise : PromiseBase {
+        void return_void() {}
+    };
+
+public:
+    struct promise_type : std::conditional_t<std::is_void_v<T>, VoidPromise, ValuePromise> {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+
+    Task(Task&& other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle_)
+            handle_.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiter) noexcept {
+        handle_.promise().continuation = waiter;
+        return handle_;
+    }
+    T await_resume() {
+        if constexpr (!std::is_void_v<T>)
+            return std::move(handle_.promise().value);
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    std::coroutine_handle<promise_type> handle_;
+};
+
+class Cluster;
+
+// Ожидание ответа на один запрос; создаётся операциями Cluster
+class RequestAwaiter {
+public:
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> waiter);
+    Reply await_resume() { return std::move(reply_); }
+
+private:
+    friend class Cluster;
+    RequestAwaiter(Cluster& cluster, message request) : cluster_(cluster), request_(std::move(request)) {}
+
+    Cluster& cluster_;
+    message request_;
+    Reply reply_;
+    std::coroutine_handle<> waiter_;
+};
+
+class Cluster {
+public:
+    explicit Cluster(std::chrono::milliseconds timeout = std::chrono::seconds(5));
+    Cluster(const Cluster&) = delete;
+    Cluster& operator=(const Cluster&) = delete;
+
+    // Узел id ребёнком parent (-1 — прямой ребёнок клиента); ok — узел на связи
+    RequestAwaiter create(int id, int parent = -1);
+    RequestAwaiter ping(int id);
+    RequestAwaiter exec_add(int id, std::string key, int64_t value);
+    RequestAwaiter exec_add_blob(int id, std::string key, std::string blob);
+    RequestAwaiter exec_find(int id, std::string key);
+    RequestAwaiter exec_del(int id, std::string key);
+    RequestAwaiter scan(int id, std::string prefix, int64_t limit = 0);
+    RequestAwaiter stats(int id);
+
+    // Запуск задачи в цикле событий; она живёт, пока не завершится
+    void spawn(Task<> task);
+    // Цикл событий до завершения всех запущенных задач
+    void run();
+    template <typename T>
+    T run(Task<T> task) {
+        if constexpr (std::is_void_v<T>) {
+            spawn(std::move(task));
+            run();
+        } else {
+            std::optional<T> result;
+            spawn(store(std::move(task), result));
+            run();
+            return std::move(*result);
+        }
+    }
+    // Одна итерация: ожидание не дольше timeout_ms (-1 — до события), приём
+    // ответов, сроки и досылка отложенного
+    void poll(long timeout_ms);
+
+    size_t in_flight() const { return pending_.size(); }
+    size_t tasks() const { return tasks_; }
+
+private:
+    friend class RequestAwaiter;
+    struct Pending {
+        RequestAwaiter* awaiter;
+        int target;
+    };
+
+    template <typename T>
+    static Task<> store(Task<T> task, std::optional<T>& result) {
+        result = co_await task;
+    }
+
+    // Отказ, известный сразу (узел перегружен или его нет), тоже завершается
+    // из следующего poll(): любой co_await проходит через цикл событий, и
+    // повторяющая запрос сопрограмма не зацикливается без приёма ответов
+    void submit(RequestAwaiter& awaiter);
+    void failNow(RequestAwaiter& awaiter, Reply::Status status);
+    void complete(uint64_t corr, Reply::Status status, message* reply = nullptr);
+    void handleReply(message& m, Node* from);
+    void failTarget(int id);
+
+    std::chrono::milliseconds timeout_;
+    ChildTable children_;
+    RoutingTable routes_;
+    void* router_ = nullptr;
+    uint64_t next_corr_ = 1;
+    std::unordered_map<uint64_t, Pending> pending_;
+    std::unordered_map<int, uint64_t> creating_; // id создаваемого узла -> запрос
+    TimerWheel<uint64_t> deadlines_{std::chrono::milliseconds(10), 1024};
+    std::vector<RequestAwaiter*> failed_now_; // отказы, ждущие следующего poll()
+    size_t tasks_ = 0;
+};
+
+#endif // CLIENT_H
@@ -0,0 +1,105 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Кластерный режим: управляющий узел сам выбирает узлы для ключа.
+//
+// Кольцо согласованного хэширования: у каждого узла VNODES точек на кольце,
+// ключ хранится на первых R различных узлах по часовой стрелке от своего хэша.
+// Новый узел забирает у остальных примерно 1/N ключей, а не перемешивает все.
+class HashRing {
+public:
+    static const int VNODES = 64;
+
+    static uint64_t hash(std::string_view data) {
+        // FNV-1a и перемешивание splitmix64: у коротких ключей FNV плохо
+        // распределяет старшие биты, а по ним идёт поиск на кольце
+        uint64_t h = 14695981039346656037ULL;
+        for (char c : data)
+            h = (h ^ (uint8_t)c) * 1099511628211ULL;
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+
+    void add(int node) {
+        if (!members_.insert(node).second)
+            return;
+        for (int i = 0; i < VNODES; ++i)
+            points_.push_back({hash(std::to_string(node) + "#" + std::to_string(i)), node});
+        std::sort(points_.begin(), points_.end());
+    }
+
+    bool contains(int node) const { return members_.count(node) > 0; }
+    size_t size() const { return members_.size(); }
+    const std::unordered_set<int>& members() const { return members_; }
+
+    // Узлы-реплики ключа в порядке предпочтения (не больше count)
+    std::vector<int> replicas(std::string_view key, size_t count) const {
+        std::vector<int> nodes;
+        count = std::min(count, members_.size());
+        if (count == 0)
+            return nodes;
+        auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(hash(key), INT32_MIN));
+        for (size_t seen = 0; nodes.size() < count && seen < points_.size(); ++seen, ++it) {
+            if (it == points_.end())
+                it = points_.begin();
+            if (std::find(nodes.begin(), nodes.end(), it->second) == nodes.end())
+                nodes.push_back(it->second);
+        }
+        return nodes;
+    }
+
+private:
+    std::vector<std::pair<uint64_t, int>> points_; // по возрастанию хэша
+    std::unordered_set<int> members_;
+};
+
+// Значение кластерного ключа хранится на узле блобом «версия тип данные»:
+// тип n — целое, b — блоб, x — удалено (надгробие). Узел сравнивает версии
+// при ExecMerge, поэтому реплики сходятся к последней записи в любом порядке
+// доставки, а удаление не «воскрешается» старой копией.
+enum VersionedType : char {
+    VersionedNumber = 'n',
+    VersionedBlob = 'b',
+    VersionedDeleted = 'x'
+};
+
+struct VersionedValue {
+    uint64_t version = 0;
+    char type = VersionedDeleted;
+    std::string_view payload;
+};
+
+inline std::string encodeVersioned(uint64_t version, char type, std::string_view payload) {
+    std::string data = std::to_string(version);
+    data += ' ';
+    data += type;
+    data += ' ';
+    data.append(payload);
+    return data;
+}
+
+inline bool decodeVersioned(std::string_view data, VersionedValue& value) {
+    auto result = std::from_chars(data.data(), data.data() + data.size(), value.version);
+    size_t pos = result.ptr - data.data();
+    if (result.ec != std::errc() || pos + 3 > data.size() || data[pos] != ' ' || data[pos + 2] != ' ')
+        return false;
+    value.type = data[pos + 1];
+    if (value.type != VersionedNumber && value.type != VersionedBlob && value.type != VersionedDeleted)
+        return false;
+    value.payload = data.substr(pos + 3);
+    return true;
+}
+
+#endif // CLUSTER_H
@@ -1,99 +1,39 @@
-#include "lib.h"
-#include <iostream>
-#include <map>
-#include <chrono>
-#include <thread>
-#include <functional>
-
-using namespace std::chrono;
-
-Node* children_root = nullptr;
+#include "node.h"
+#include <cstring>
 
 int main(int argc, char *argv[])
 {
-    // Создаем узел текущего процесса
-    Node I = createNode(atoi(argv[1]), true);
-    std::map<std::string, int> dict;
-
-    // Переменные для heartbeat
-    std::chrono::milliseconds local_heartbeat(0);
-    auto last_beat = steady_clock::now();
-
-    while (true)
+    // Создаем узел текущего процесса и подключаемся к родителю (argv[2] — его адрес,
+    // дети подключаются через тот же транспорт). Далее: --parent <pid> — процесс
+    // родителя, с ним узел и завершается; необязательно --data-dir <каталог>,
+    // --workers <N> — число потоков-обработчиков словаря (0 — в потоке цикла),
+    // --spawn fork|posix — способ запуска своих детей и пределы потока сообщений
+    // --hwm, --outbox, --window (lib.h, FlowLimits).
+    // Подтверждение создания отправляет сам узел после восстановления словаря,
+    // поэтому оно означает, что узел уже на связи.
+    for (int i = 3; i + 1 < argc; i += 2)
     {
-        // Периодическая отправка heartbeat-сообщения родительскому узлу
-        if (local_heartbeat > std::chrono::milliseconds::zero() &&
-            duration_cast<milliseconds>(steady_clock::now() - last_beat).count() > local_heartbeat.count())
+        SpawnMode mode;
+        if (strcmp(argv[i], "--parent") == 0)
         {
-            message hb(HeartBeat, I.id, -1);
-            send_mes(I, hb);
-            last_beat = steady_clock::now();
+            if (!watchParent(atoi(argv[i + 1])))
+                return 1;
         }
-
-        // Обрабатываем сообщения от дочерних узлов
-        traverseChildren(children_root, [&](Node& child) {
-            message m = get_mes(child);
-            if (m.command != None)
-                send_mes(I, m);
-        });
-
-        // Проверяем сообщение от родителя
-        message m = get_mes(I);
-        switch (m.command)
+        else if (strcmp(argv[i], "--data-dir") == 0)
+            setDataDir(argv[i + 1]);
+        else if (strcmp(argv[i], "--workers") == 0)
+            setNodeWorkers(atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--spawn") == 0 && parseSpawnMode(argv[i + 1], mode))
+            setSpawnMode(mode);
+        else if (!parseFlowOption(argv[i], argv[i + 1]))
         {
-        case Create:
-            if (m.id == I.id)
-            {
-                Node child = createProcess(m.num);
-                Node* childPtr = new Node(child);
-                children_root = insertChild(children_root, childPtr);
-                send_mes(I, {Create, child.id, child.pid});
-            }
-            else
-                traverseChildren(children_root, [&](Node& child) {
-                    send_mes(child, m);
-                });
-            break;
-        case Ping:
-            if (m.id == I.id)
-                send_mes(I, m);
-            else
-                traverseChildren(children_root, [&](Node& child) {
-                    send_mes(child, m);
-                });
-            break;
-        case ExecAdd:
-            if (m.id == I.id)
-            {
-                dict[std::string(m.st)] = m.num;
-                send_mes(I, m);
-            }
-            else
-                traverseChildren(children_root, [&](Node& child) {
-                    send_mes(child, m);
-                });
-            break;
-        case ExecFnd:
-            if (m.id == I.id)
-            {
-                if (dict.find(std::string(m.st)) != dict.end())
-                    send_mes(I, {ExecFnd, I.id, dict[std::string(m.st)], m.st});
-                else
-                    send_mes(I, {ExecErr, I.id, -1, m.st});
-            }
-            else
-                traverseChildren(children_root, [&](Node& child) {
-                    send_mes(child, m);
-                });
-            break;
-        case HeartBeat:
-            // Обновляем локальный интервал heartbeat при получении команды от управляющего узла
-            local_heartbeat = std::chrono::milliseconds(m.num);
-            break;
-        default:
-            break;
+            // Пределы потока должны совпадать с родительскими: иначе окно
+            // кредитов у родителя и у узла разное
+            std::cerr << "Node " << argv[1] << ": bad option " << argv[i] << ' ' << argv[i + 1] << std::endl;
+            return 1;
         }
-        usleep(1000000);
     }
-    return 0;
+    childExitFd(); // SIGCHLD блокируется до появления потоков ZeroMQ
+    setTransport(transportOf(argv[2]));
+    return runNode(atoi(argv[1]), argv[2]);
 }
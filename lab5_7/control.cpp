@@ -1,225 +1,1079 @@
 #include "lib.h"
-#include <cstdio>      // для fgets, sscanf
-#include <fcntl.h>     // для fcntl, O_NONBLOCK
+#include "timer_wheel.h"
+#include "cluster.h"
+#include "metrics.h"
+#include <cstdio>      // для sscanf
 #include <unistd.h>
 #include <errno.h>
 #include <string>
+#include <charconv>
+#include <deque>
+#include <optional>
+#include <fcntl.h>
 
-Node* children_root = nullptr;
+// Размер пакета операций одному узлу и число запросов в полёте в режиме нагрузки
+const size_t BATCH_MAX = 256;
+const size_t WINDOW = 64;
+// Число детей у узла при автоматическом размещении (create без родителя)
+const size_t AUTO_FANOUT = 8;
+// Предел --workers: больше потоков на узел, чем ядер, смысла не имеет
+const int MAX_NODE_WORKERS = 64;
 
-int main()
+// Операция exec, ожидающая упаковки
+struct ExecOp {
+    com command;
+    int64_t num;
+    std::string key;
+    bool is_blob;
+    std::string blob;
+    uint64_t tag = 0; // кластерная операция, которой принадлежит результат (0 — вывести как есть)
+};
+
+// Запросы, ожидающие ответа: поиск по идентификатору запроса за O(1),
+// сроки — в колесе таймеров (такт 100 мс, оборот 12.8 с больше срока ответа)
+const std::chrono::seconds REPLY_TIMEOUT(5);
+
+struct PendingRequests {
+    struct Entry {
+        message request;
+        std::vector<uint64_t> tags; // ExecOp::tag каждой операции, если среди них есть кластерные
+    };
+    std::unordered_map<uint64_t, Entry> requests;
+    std::unordered_map<int, uint64_t> creating; // id создаваемого узла -> запрос
+    TimerWheel<uint64_t> deadlines{std::chrono::milliseconds(100), 128};
+
+    void add(const message& m, std::vector<uint64_t> tags = {}) {
+        requests.emplace(m.corr, Entry{m, std::move(tags)});
+        if (m.command == Create)
+            creating[m.num] = m.corr;
+        deadlines.schedule(TimerWheel<uint64_t>::Clock::now() + REPLY_TIMEOUT, m.corr);
+    }
+
+    // Извлекает запрос; запись в колесе остаётся и будет пропущена при срабатывании
+    bool take(uint64_t corr, message& request, std::vector<uint64_t>* tags = nullptr) {
+        auto it = requests.find(corr);
+        if (it == requests.end())
+            return false;
+        request = std::move(it->second.request);
+        if (tags)
+            *tags = std::move(it->second.tags);
+        requests.erase(it);
+        if (request.command == Create)
+            creating.erase(request.num);
+        return true;
+    }
+
+    // Извлекает все запросы к узлу id (и создание его самого)
+    std::vector<Entry> takeFor(int id) {
+        std::vector<Entry> taken;
+        for (auto it = requests.begin(); it != requests.end();)
+        {
+            const message& request = it->second.request;
+            if (request.id == id || (request.command == Create && request.num == id))
+            {
+                if (request.command == Create)
+                    creating.erase(request.num);
+                taken.push_back(std::move(it->second));
+                it = requests.erase(it);
+            }
+            else
+                ++it;
+        }
+        return taken;
+    }
+
+    size_t size() const { return requests.size(); }
+    bool empty() const { return requests.empty(); }
+};
+
+// Кластерная операция put/get/remove: ключ на нескольких репликах, ответ —
+// после кворума. Запись уходит на все реплики, чтение — на кворум реплик,
+// а при отказе одной из них — на следующую. Rebalance копирует на узел target
+// ключи, для которых он стал репликой.
+const uint64_t REPAIR_TAG = UINT64_MAX; // фоновая запись без вывода результата
+
+struct ClusterOp {
+    com command;             // ExecAdd — put, ExecFnd — get, ExecDel — remove, ExecScan — rebalance
+    std::string key;
+    std::vector<int> replicas;
+    size_t next_replica = 0; // следующая непросмотренная реплика
+    size_t needed = 0;       // кворум
+    size_t acks = 0;
+    size_t outstanding = 0;
+    bool reported = false;
+    // Чтение: самая новая версия и версии ответивших реплик для восстановления отставших
+    std::string best;
+    uint64_t best_version = 0;
+    std::vector<std::pair<int, uint64_t>> seen;
+};
+
+// Слова строки без копирования (разбор через istringstream был узким местом
+// при сотнях тысяч команд в секунду)
+std::vector<std::string_view> splitWords(std::string_view line)
+{
+    std::vector<std::string_view> words;
+    size_t pos = 0;
+    while (true)
+    {
+        pos = line.find_first_not_of(" \t\r", pos);
+        if (pos == std::string_view::npos)
+            return words;
+        size_t end = line.find_first_of(" \t\r", pos);
+        if (end == std::string_view::npos)
+            end = line.size();
+        words.push_back(line.substr(pos, end - pos));
+        pos = end;
+    }
+}
+
+template <typename T>
+bool parseInt(std::string_view word, T& value)
+{
+    auto result = std::from_chars(word.data(), word.data() + word.size(), value);
+    return result.ec == std::errc() && result.ptr == word.data() + word.size();
+}
+
+// Ответ stats: строки счётчиков с отступом, как записи скана
+void printStats(int id, std::string_view lines)
+{
+    std::cout << "Ok: " << id << " stats" << '\n';
+    size_t start = 0, end;
+    while ((end = lines.find('\n', start)) != std::string_view::npos)
+    {
+        std::cout << "  " << lines.substr(start, end - start) << '\n';
+        start = end + 1;
+    }
+}
+
+// Вывод результата одной операции exec/del; значение — число или блоб
+void printExecResult(int id, com result, std::string_view key, int64_t num, bool is_blob, std::string_view blob)
 {
+    if (result == ExecAdd)
+        std::cout << "Ok: " << id << '\n';
+    else if (result == ExecFnd && is_blob)
+        std::cout << "Ok: " << id << " '" << key << "' " << blob << '\n';
+    else if (result == ExecFnd)
+        std::cout << "Ok: " << id << " '" << key << "' " << num << '\n';
+    else if (result == ExecDel && num)
+        std::cout << "Ok: " << id << " '" << key << "' deleted" << '\n';
+    else
+        std::cout << "Ok: " << id << " '" << key << "' not found" << '\n';
+}
+
+int main(int argc, char* argv[])
+{
+    // --transport tcp|ipc|inproc — транспорт между узлами (по умолчанию tcp);
+    // inproc — все узлы потоками в этом процессе, для опытов с тысячами узлов
+    // --workload <файл> — неинтерактивный режим: команды из файла с максимальной
+    // скоростью, exec к одному узлу упаковываются в пакеты, в конце — сводка
+    // --data-dir <каталог> — узлы пишут журнал и снимки и восстанавливают из них
+    // словарь при запуске с тем же id
+    // --replicas R, --write-quorum W, --read-quorum Q — кластерные команды
+    // put/get/remove (по умолчанию 3, 2, 2)
+    // --workers N — потоки-обработчики словаря на каждом узле (по умолчанию 1;
+    // 0 — словарь обслуживает сам цикл событий узла)
+    // --spawn posix|fork — запуск узлов через posix_spawn (по умолчанию) или fork + exec
+    // --hwm N, --outbox N, --window N — очередь ZeroMQ, outbox и окно запросов на
+    // каждого ребёнка (lib.h, FlowLimits); сверх них запросы получают ответ busy
+    int input_fd = STDIN_FILENO;
+    bool workload = false;
+    size_t replication = 3, write_quorum = 2, read_quorum = 2;
+    int workers;
+    SpawnMode spawn_mode;
+    for (int i = 1; i < argc; ++i)
+    {
+        Transport transport;
+        std::string arg = argv[i];
+        if (arg == "--transport" && i + 1 < argc && parseTransport(argv[i + 1], transport))
+        {
+            setTransport(transport);
+            ++i;
+        }
+        else if (arg == "--workload" && i + 1 < argc)
+        {
+            input_fd = open(argv[++i], O_RDONLY);
+            if (input_fd == -1)
+            {
+                std::cerr << "Cannot open " << argv[i] << std::endl;
+                return 1;
+            }
+            workload = true;
+        }
+        else if (arg == "--data-dir" && i + 1 < argc)
+            setDataDir(argv[++i]);
+        else if (arg == "--replicas" && i + 1 < argc && parseInt(argv[i + 1], replication))
+            ++i;
+        else if (arg == "--write-quorum" && i + 1 < argc && parseInt(argv[i + 1], write_quorum))
+            ++i;
+        else if (arg == "--read-quorum" && i + 1 < argc && parseInt(argv[i + 1], read_quorum))
+            ++i;
+        else if (arg == "--spawn" && i + 1 < argc && parseSpawnMode(argv[i + 1], spawn_mode))
+        {
+            setSpawnMode(spawn_mode);
+            ++i;
+        }
+        else if (i + 1 < argc && parseFlowOption(arg, argv[i + 1]))
+            ++i;
+        else if (arg == "--workers" && i + 1 < argc && parseInt(argv[i + 1], workers) && workers >= 0
+                 && workers <= MAX_NODE_WORKERS)
+        {
+            setNodeWorkers(workers);
+            ++i;
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--transport tcp|ipc|inproc] [--workload <file>] [--data-dir <dir>]"
+                      << " [--replicas R] [--write-quorum W] [--read-quorum Q] [--workers N]"
+                      << " [--spawn posix|fork] [--hwm N] [--outbox N] [--window N]" << std::endl;
+            return 1;
+        }
+    }
+    if (replication == 0 || write_quorum == 0 || read_quorum == 0 || write_quorum > replication
+        || read_quorum > replication)
+    {
+        std::cerr << "Quorums must be between 1 and the number of replicas" << std::endl;
+        return 1;
+    }
+    std::ios::sync_with_stdio(false);
+    // SIGCHLD блокируется до появления потоков ZeroMQ
+    childExitFd();
+
     std::unordered_set<int> all_id;
     // Управляющий узел имеет id -1
     all_id.insert(-1);
-    std::list<message> saved_mes;
-    std::string command;
+    PendingRequests pending;
+    ChildTable children;
+    RoutingTable routes;
+    void* router = nullptr; // общий сокет прямых детей, появляется с первым ребёнком
+    uint64_t next_corr = 1;
+    uint64_t exec_ops = 0;
+    std::unordered_map<int, std::vector<ExecOp>> batches; // id узла -> операции
+    // Узлы, которые упали и ещё не перезапустились или пропустили heartbeat:
+    // запросы к ним сразу завершаются ошибкой, а не ждут срока ответа
+    std::unordered_set<int> down;
+    // trace on: запросы несут отметки узлов, для каждого ответа печатается разбивка по участкам
+    bool tracing = false;
 
-    while (true)
-    {
-        // Обрабатываем входящие сообщения от прямых детей
-        traverseChildren(children_root, [&](Node& child) {
-            message m = get_mes(child);
-            switch (m.command)
-            {
-            case Create:
-                all_id.insert(m.num);
-                std::cout << "Ok: " << m.num << std::endl;
-                for (auto it = saved_mes.begin(); it != saved_mes.end(); ++it)
-                {
-                    if (it->command == Create && it->num == m.num)
-                    {
-                        saved_mes.erase(it);
-                        break;
-                    }
-                }
-                break;
-            case Ping:
-                std::cout << "Ok: " << m.id << " is available" << std::endl;
-                for (auto it = saved_mes.begin(); it != saved_mes.end(); ++it)
-                {
-                    if (it->command == Ping && it->id == m.id)
-                    {
-                        saved_mes.erase(it);
-                        break;
-                    }
-                }
-                break;
-            case ExecErr:
-                std::cout << "Ok: " << m.id << " '" << m.st << "' not found" << std::endl;
-                for (auto it = saved_mes.begin(); it != saved_mes.end(); ++it)
+    // Кластерный режим: кольцо из всех вычислительных узлов и операции в работе
+    HashRing ring;
+    std::unordered_map<uint64_t, ClusterOp> cluster_ops;
+    uint64_t next_op = 1;
+    uint64_t last_version = 0;
+    size_t read_rotation = 0;
+    bool cluster_used = false; // rebalance нужен, только если уже были кластерные записи
+    bool batch_full = false;   // пакет какого-то узла достиг BATCH_MAX
+
+    // Узлы без явного родителя заполняют дерево по уровням: у каждого не больше
+    // AUTO_FANOUT детей, поэтому глубина растёт как log(n). В placed — узлы в
+    // порядке подтверждения создания, начиная с управляющего. Если свободного
+    // места нет, пока не подтверждены уже отправленные create, узел ждёт в
+    // waiting_creates; место, занятое неудавшимся create, освобождается.
+    // Дети, созданные с явным родителем, занимают места в том же счёте
+    std::vector<int> placed = {-1};
+    size_t next_parent = 0; // все узлы до него уже заполнены
+    std::unordered_map<int, size_t> placed_children;
+    std::unordered_set<int> auto_created; // ждут подтверждения, чтобы попасть в placed
+    std::deque<int> waiting_creates;
+
+    auto autoParent = [&]() -> std::optional<int> {
+        while (next_parent < placed.size() && placed_children[placed[next_parent]] >= AUTO_FANOUT)
+            ++next_parent;
+        for (size_t i = next_parent; i < placed.size(); ++i)
+        {
+            if (placed_children[placed[i]] < AUTO_FANOUT && !down.count(placed[i]))
+                return placed[i];
+        }
+        return std::nullopt;
+    };
+
+    // Версия записи: время в микросекундах, но строго больше предыдущей
+    auto nextVersion = [&]() {
+        uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        last_version = std::max(last_version + 1, micros);
+        return last_version;
+    };
+
+    auto queueMerge = [&](int node, const std::string& key, const std::string& value, uint64_t tag) {
+        std::vector<ExecOp>& ops = batches[node];
+        ops.push_back({ExecMerge, 0, key, true, value, tag});
+        batch_full |= ops.size() >= BATCH_MAX;
+    };
+
+    // Чтение с очередной реплики; недоступные узлы пропускаются сразу
+    auto readNext = [&](uint64_t tag, ClusterOp& op) {
+        while (op.next_replica < op.replicas.size())
+        {
+            int node = op.replicas[op.next_replica++];
+            if (down.count(node))
+                continue;
+            std::vector<ExecOp>& ops = batches[node];
+            ops.push_back({ExecFnd, -1, op.key, false, {}, tag});
+            batch_full |= ops.size() >= BATCH_MAX;
+            ++op.outstanding;
+            return true;
+        }
+        return false;
+    };
+
+    // Итог операции, как только он известен; запись удаляется, когда ответили все
+    auto settle = [&](std::unordered_map<uint64_t, ClusterOp>::iterator it) {
+        ClusterOp& op = it->second;
+        if (op.command == ExecScan)
+        {
+            if (op.outstanding > 0)
+                return;
+            if (op.acks > 0)
+                std::cerr << "Rebalance: " << op.acks << " copies sent to node " << op.replicas[0] << std::endl;
+            cluster_ops.erase(it);
+            return;
+        }
+        size_t possible = op.acks + op.outstanding + (op.command == ExecFnd ? op.replicas.size() - op.next_replica : 0);
+        if (!op.reported && op.acks >= op.needed)
+        {
+            op.reported = true;
+            VersionedValue value;
+            if (op.command == ExecAdd)
+                std::cout << "Ok: '" << op.key << "'" << '\n';
+            else if (op.command == ExecDel)
+                std::cout << "Ok: '" << op.key << "' deleted" << '\n';
+            else if (decodeVersioned(op.best, value) && value.type != VersionedDeleted)
+                std::cout << "Ok: '" << op.key << "' " << value.payload << '\n';
+            else
+                std::cout << "Ok: '" << op.key << "' not found" << '\n';
+        }
+        else if (!op.reported && possible < op.needed)
+        {
+            op.reported = true;
+            std::cout << "Error: '" << op.key << "' quorum not reached" << '\n';
+        }
+        if (op.outstanding > 0)
+            return;
+        // Восстановление при чтении: отставшие реплики получают последнюю версию
+        if (op.command == ExecFnd && op.best_version > 0)
+        {
+            for (auto [node, version] : op.seen)
+            {
+                if (version < op.best_version)
+                    queueMerge(node, op.key, op.best, REPAIR_TAG);
+            }
+        }
+        cluster_ops.erase(it);
+    };
+
+    // Результат одной операции реплики node для кластерной операции tag
+    auto clusterResult = [&](uint64_t tag, int node, com result, bool is_blob, std::string_view blob) {
+        auto it = cluster_ops.find(tag);
+        if (it == cluster_ops.end())
+            return;
+        ClusterOp& op = it->second;
+        --op.outstanding;
+        if (op.command == ExecFnd)
+        {
+            // Отсутствие ключа — тоже ответ (версия 0)
+            VersionedValue value;
+            uint64_t version = 0;
+            if (result == ExecFnd && is_blob && decodeVersioned(blob, value))
+                version = value.version;
+            if (result == ExecFnd || result == ExecErr)
+            {
+                ++op.acks;
+                op.seen.push_back({node, version});
+            }
+            if (version > op.best_version)
+            {
+                op.best_version = version;
+                op.best = std::string(blob);
+            }
+        }
+        else if (result == ExecMerge)
+            ++op.acks;
+        settle(it);
+    };
+
+    // Реплика не ответила: чтение переходит к следующей
+    auto clusterFailure = [&](uint64_t tag) {
+        auto it = cluster_ops.find(tag);
+        if (it == cluster_ops.end())
+            return;
+        ClusterOp& op = it->second;
+        --op.outstanding;
+        if (op.command == ExecFnd)
+            readNext(tag, op);
+        settle(it);
+    };
+
+    // Ошибка по запросу, оставшемуся без ответа или отвергнутому (state — busy);
+    // кластерные операции в нём учитывают отказ реплики, остальные выводят ошибку.
+    // Кредит запроса у прямого ребёнка освобождается: ответа, который вернул бы
+    // его, может уже не быть
+    auto failRequest = [&](const message& request, const std::vector<uint64_t>& tags,
+                           const char* state = "unavailable") {
+        if (Node* via = routes.find(request.id))
+            releaseCredit(*via, request.corr);
+        bool plain = tags.empty();
+        for (uint64_t tag : tags)
+        {
+            if (tag == 0)
+                plain = true;
+            else if (tag != REPAIR_TAG)
+                clusterFailure(tag);
+        }
+        if (!plain)
+            return;
+        switch (request.command)
+        {
+        case Ping:
+            std::cout << "Error:" << request.id << " is " << state << '\n';
+            break;
+        case Create:
+            auto_created.erase(request.num);
+            --placed_children[request.id];
+            next_parent = 0;
+            std::cout << "Error: Parent " << request.id << " is " << state << '\n';
+            break;
+        case ExecAdd:
+        case ExecFnd:
+        case ExecDel:
+        case ExecScan:
+        case ExecRange:
+        case Batch:
+        case Stats:
+            std::cout << "Error: Node " << request.id << " is " << state << '\n';
+            break;
+        default:
+            break;
+        }
+    };
+
+    auto markDown = [&](int id) {
+        if (!down.insert(id).second)
+            return;
+        for (const PendingRequests::Entry& entry : pending.takeFor(id))
+            failRequest(entry.request, entry.tags);
+    };
+
+    auto markUp = [&](int id) {
+        if (!down.erase(id))
+            return false;
+        std::cout << "Node: " << id << " is available again" << '\n';
+        return true;
+    };
+
+    // Отправка запроса узлу id по таблице маршрутов
+    auto sendTo = [&](int id, message m, std::vector<uint64_t> tags = {}) {
+        m.corr = next_corr++;
+        if (tracing && m.command != Create)
+        {
+            m.flags |= WIRE_TRACE;
+            traceHop(m.trace, -1);
+        }
+        pending.add(m, std::move(tags));
+        // Создание запоминается у прямого ребёнка для восстановления поддерева
+        if (m.command == Create)
+        {
+            if (Node* via = routes.find(id))
+                via->subtree_creates.push_back(m);
+        }
+        SendResult result = forward(routes, id, m);
+        if (result == SendBusy || result == SendNoRoute)
+        {
+            message request;
+            std::vector<uint64_t> tags;
+            if (pending.take(m.corr, request, &tags))
+                failRequest(request, tags, result == SendBusy ? "busy" : "unavailable");
+        }
+    };
+
+    // Отправка накопленных exec: одна операция — обычным сообщением,
+    // несколько — одним пакетом Batch с одним ответом
+    auto flushBatches = [&]() {
+        for (auto& [id, ops] : batches)
+        {
+            std::vector<uint64_t> tags;
+            if (std::any_of(ops.begin(), ops.end(), [](const ExecOp& op) { return op.tag != 0; }))
+            {
+                for (const ExecOp& op : ops)
+                    tags.push_back(op.tag);
+            }
+            if (ops.size() == 1)
+            {
+                message m(ops[0].command, id, ops[0].num, ops[0].key);
+                if (ops[0].is_blob)
                 {
-                    if (it->command == ExecFnd && it->id == m.id)
-                    {
-                        saved_mes.erase(it);
-                        break;
-                    }
+                    m.flags = WIRE_BLOB;
+                    m.value = ops[0].blob;
                 }
+                sendTo(id, m, std::move(tags));
+            }
+            else if (!ops.empty())
+            {
+                message m(Batch, id, (int64_t)ops.size());
+                for (const ExecOp& op : ops)
+                    batch_append(m.value, op.command | (op.is_blob ? BATCH_BLOB : 0), op.num, op.key, op.blob);
+                sendTo(id, m, std::move(tags));
+            }
+            ops.clear();
+        }
+        batch_full = false;
+    };
+
+    // Rebalance: каждый узел присылает свои ключи, и target получает те, для
+    // которых он теперь реплика. Скан идёт после уже накопленных записей.
+    auto rebalanceTo = [&](int target) {
+        flushBatches();
+        uint64_t tag = next_op++;
+        ClusterOp op;
+        op.command = ExecScan;
+        op.replicas = {target};
+        for (int node : ring.members())
+        {
+            if (node == target || down.count(node))
+                continue;
+            sendTo(node, message(ExecScan, node, 0, ""), {tag});
+            ++op.outstanding;
+        }
+        if (op.outstanding > 0)
+            cluster_ops.emplace(tag, std::move(op));
+    };
+
+    // Ответ, пришедший через прямого ребёнка from
+    auto handleReply = [&](message& m, Node* from) {
+        switch (m.command)
+        {
+        case Create:
+            // id — новый узел, num — его pid. Прямой ребёнок присылает это
+            // подтверждение сам при подключении, его pid уже выведен при создании.
+            if (m.id == from->id)
+                markReady(*from);
+            if (auto_created.erase(m.id))
+                placed.push_back(m.id);
+            all_id.insert(m.id);
+            routes.add(m.id, from);
+            {
+                // Новый или перезапущенный узел получает ключи, репликой которых он стал
+                bool restarted = markUp(m.id);
+                bool joined = !ring.contains(m.id);
+                ring.add(m.id);
+                if (cluster_used && (joined || restarted))
+                    rebalanceTo(m.id);
+            }
+            {
+                // Подтверждение приходит от самого узла, без идентификатора запроса
+                auto it = pending.creating.find(m.id);
+                message request;
+                if (it != pending.creating.end() && pending.take(it->second, request))
+                    std::cout << "Ok: " << m.num << '\n';
+            }
+            break;
+        case Ping:
+        {
+            message request;
+            if (pending.take(m.corr, request))
+                std::cout << "Ok: " << m.id << " is available" << '\n';
+            break;
+        }
+        case Stats:
+        {
+            message request;
+            if (pending.take(m.corr, request))
+                printStats(m.id, m.value);
+            break;
+        }
+        case ExecErr:
+        case ExecAdd:
+        case ExecFnd:
+        case ExecDel:
+        case ExecMerge:
+        {
+            // Ключ берётся из запроса: в ответе его нет
+            message request;
+            std::vector<uint64_t> tags;
+            if (!pending.take(m.corr, request, &tags))
                 break;
-            case ExecAdd:
-                std::cout << "Ok: " << m.id << std::endl;
-                for (auto it = saved_mes.begin(); it != saved_mes.end(); ++it)
-                {
-                    if (it->command == ExecAdd && it->id == m.id)
-                    {
-                        saved_mes.erase(it);
-                        break;
-                    }
-                }
+            if (tags.empty())
+                printExecResult(m.id, m.command, request.st, m.num, m.flags & WIRE_BLOB, m.value);
+            else if (tags[0] != REPAIR_TAG)
+                clusterResult(tags[0], m.id, m.command, m.flags & WIRE_BLOB, m.value);
+            break;
+        }
+        case ExecScan:
+        {
+            message request;
+            std::vector<uint64_t> tags;
+            if (!pending.take(m.corr, request, &tags))
                 break;
-            case ExecFnd:
-                std::cout << "Ok: " << m.id << " '" << m.st << "' " << m.num << std::endl;
-                for (auto it = saved_mes.begin(); it != saved_mes.end(); ++it)
+            const char* pos = m.value.data();
+            const char* end = pos + m.value.size();
+            uint8_t command;
+            int64_t num;
+            std::string_view key, blob;
+            if (!tags.empty())
+            {
+                // Скан для rebalance: копируем целевому узлу его кластерные ключи
+                auto it = cluster_ops.find(tags[0]);
+                if (it == cluster_ops.end())
+                    break;
+                ClusterOp& op = it->second;
+                int target = op.replicas[0];
+                VersionedValue value;
+                while (batch_next(pos, end, command, num, key, blob))
                 {
-                    if (it->command == ExecFnd && it->id == m.id)
-                    {
-                        saved_mes.erase(it);
-                        break;
-                    }
+                    if (!(command & BATCH_BLOB) || !decodeVersioned(blob, value))
+                        continue;
+                    std::vector<int> replicas = ring.replicas(key, replication);
+                    if (std::find(replicas.begin(), replicas.end(), target) == replicas.end())
+                        continue;
+                    queueMerge(target, std::string(key), std::string(blob), REPAIR_TAG);
+                    ++op.acks;
                 }
-                break;
-            case HeartBeat:
-                update_beat(m.id);
-                break;
-            default:
+                --op.outstanding;
+                settle(it);
                 break;
             }
-        });
-
-        // Проверяем недошедшие сообщения
-        for (auto it = saved_mes.begin(); it != saved_mes.end(); ++it)
-        {
-            if (std::difftime(t_now(), it->sent_time) > 5)
+            std::cout << "Ok: " << m.id << " found " << m.num << '\n';
+            while (batch_next(pos, end, command, num, key, blob))
             {
-                switch (it->command)
-                {
-                case Ping:
-                    std::cout << "Error:" << it->id << " is unavailable" << std::endl;
-                    break;
-                case Create:
-                    std::cout << "Error: Parent " << it->id << " is unavailable" << std::endl;
-                    break;
-                case ExecAdd:
-                case ExecFnd:
-                    std::cout << "Error: Node " << it->id << " is unavailable" << std::endl;
-                    break;
-                default:
-                    break;
-                }
-                saved_mes.erase(it);
+                std::cout << "  '" << key << "' ";
+                if (command & BATCH_BLOB)
+                    std::cout << blob << '\n';
+                else
+                    std::cout << num << '\n';
+            }
+            break;
+        }
+        case Batch:
+        {
+            // Результаты идут в порядке операций запроса
+            message request;
+            std::vector<uint64_t> tags;
+            if (!pending.take(m.corr, request, &tags))
                 break;
+            const char* ops = request.value.data();
+            const char* ops_end = ops + request.value.size();
+            const char* results = m.value.data();
+            const char* results_end = results + m.value.size();
+            uint8_t command, result;
+            int64_t num, value;
+            std::string_view key, op_blob, unused, blob;
+            for (size_t i = 0; batch_next(ops, ops_end, command, num, key, op_blob)
+                               && batch_next(results, results_end, result, value, unused, blob); ++i)
+            {
+                uint64_t tag = i < tags.size() ? tags[i] : 0;
+                if (tag == 0)
+                    printExecResult(m.id, (com)(result & ~BATCH_BLOB), key, value, result & BATCH_BLOB, blob);
+                else if (tag != REPAIR_TAG)
+                    clusterResult(tag, m.id, (com)(result & ~BATCH_BLOB), result & BATCH_BLOB, blob);
             }
+            break;
         }
+        case HeartBeat:
+            // Сводка поддерева прямого ребёнка: каждый узел в ней жив
+            handle_beat_summary(m.value, m.id, [&](int id) { markUp(id); });
+            break;
+        case Unavailable:
+            // С corr — отказ по одному запросу (потерян в упавшем узле или нет
+            // маршрута), без него — узел id упал
+            if (m.corr)
+            {
+                message request;
+                std::vector<uint64_t> tags;
+                if (pending.take(m.corr, request, &tags))
+                    failRequest(request, tags);
+            }
+            else
+                markDown(m.id);
+            break;
+        case Busy:
+        {
+            // Отказ перегруженного узла на пути: ошибка сразу, без срока ответа
+            message request;
+            std::vector<uint64_t> tags;
+            if (pending.take(m.corr, request, &tags))
+                failRequest(request, tags, "busy");
+            break;
+        }
+        default:
+            break;
+        }
+    };
+
+    auto nodeExists = [&](int id) {
+        if (!all_id.count(id))
+        {
+            std::cout << "Error: Node with id " << id << " doesn't exist" << '\n';
+            return false;
+        }
+        if (down.count(id))
+        {
+            std::cout << "Error: Node " << id << " is unavailable" << '\n';
+            return false;
+        }
+        return true;
+    };
+
+    // Создание узла child_id ребёнком parent_id (-1 — управляющего)
+    auto createNode = [&](int child_id, int parent_id, bool auto_placed) {
+        if (parent_id == -1)
+        {
+            Node* child = children.add(createProcess(-1, child_id));
+            router = child->socket;
+            routes.add(child_id, child);
+            all_id.insert(child_id);
+            // Ok с pid выводится по подтверждению от самого узла, как и для
+            // вложенных: до него узел ещё не в кольце кластера
+            message request(Create, -1, child_id);
+            request.corr = next_corr++;
+            pending.add(request);
+        }
+        else if (!all_id.count(parent_id))
+        {
+            std::cout << "Error: Parent with id " << parent_id << " not found" << '\n';
+            return;
+        }
+        else if (down.count(parent_id))
+        {
+            std::cout << "Error: Parent " << parent_id << " is unavailable" << '\n';
+            return;
+        }
+        else
+            sendTo(parent_id, message(Create, parent_id, child_id));
+        ++placed_children[parent_id];
+        if (auto_placed)
+            auto_created.insert(child_id);
+    };
 
-        // Проверяем heartbeat – сообщения о недоступности выводятся не чаще, чем раз в 5 секунд
-        check_beats();
+    // Ждущие места узлы размещаются, пока оно есть. Если места нет и ждать
+    // нечего (неподтверждённых create не осталось), create отвергается
+    auto placeWaiting = [&]() {
+        while (!waiting_creates.empty())
+        {
+            std::optional<int> parent_id = autoParent();
+            if (!parent_id && !auto_created.empty())
+                return;
+            int child_id = waiting_creates.front();
+            waiting_creates.pop_front();
+            if (parent_id)
+                createNode(child_id, *parent_id, true);
+            else
+                std::cout << "Error: No free parent for " << child_id << '\n';
+        }
+    };
 
-        // Обрабатываем команды ввода
-        if (!inputAvailable())
-            continue;
-        std::cin >> command;
+    // Команда из одной строки ввода
+    auto handleCommand = [&](const std::string& line) {
+        std::vector<std::string_view> words = splitWords(line);
+        if (words.empty())
+            return;
+        std::string_view command = words[0];
+        std::string rest(line, words[0].data() + words[0].size() - line.data());
+        const char* input_line = rest.c_str();
         if (command == "create")
         {
-            // Читаем оставшуюся часть строки
-            char input_line[100];
-            fgets(input_line, sizeof(input_line), stdin);
             int child_id, parent_id = -1;
             int count = sscanf(input_line, "%d %d", &child_id, &parent_id);
             if (count < 1)
             {
-                std::cout << "Error: Missing child id" << std::endl;
-                continue;
+                std::cout << "Error: Missing child id" << '\n';
+                return;
             }
-            if (count == 1 || (count == 2 && parent_id == -1))
+            if (all_id.count(child_id) || auto_created.count(child_id)
+                || std::find(waiting_creates.begin(), waiting_creates.end(), child_id) != waiting_creates.end())
             {
-                if (all_id.count(child_id))
-                {
-                    std::cout << "Error: Node with id " << child_id << " already exists" << std::endl;
-                }
-                else
-                {
-                    Node child = createProcess(child_id);
-                    Node* childPtr = new Node(child);
-                    children_root = insertChild(children_root, childPtr);
-                    all_id.insert(child_id);
-                    std::cout << "Ok: " << child.pid << std::endl;
-                }
+                std::cout << "Error: Node with id " << child_id << " already exists" << '\n';
+                return;
             }
-            else
+            if (count == 1)
             {
-                message m(Create, parent_id, child_id);
-                saved_mes.push_back(m);
-                Node* parentNode = searchChild(children_root, parent_id);
-                if (parentNode)
-                    send_mes(*parentNode, m);
-                else
-                    std::cout << "Error: Parent with id " << parent_id << " not found" << std::endl;
+                // Порядок автоматических create сохраняется: ждущие идут первыми
+                waiting_creates.push_back(child_id);
+                placeWaiting();
+                return;
             }
+            createNode(child_id, parent_id, false);
         }
         else if (command == "exec")
         {
-            char input_line[100];
-            fgets(input_line, sizeof(input_line), stdin);
-            int id, val;
-            char key[30];
-            if (sscanf(input_line, "%d %30s %d", &id, key, &val) == 3)
+            // Ключ любой длины: exec id key [value]; значение — 64-битное целое,
+            // иначе блоб (весь остаток строки)
+            int id;
+            int64_t val;
+            if (words.size() < 3 || !parseInt(words[1], id) || !nodeExists(id))
+                return;
+            std::string key(words[2]);
+            // Операции копятся до конца текущей порции ввода
+            std::vector<ExecOp>& ops = batches[id];
+            if (words.size() == 3)
+                ops.push_back({ExecFnd, -1, key, false, {}});
+            else if (words.size() == 4 && parseInt(words[3], val))
+                ops.push_back({ExecAdd, val, key, false, {}});
+            else
             {
-                if (!all_id.count(id))
-                {
-                    std::cout << "Error: Node with id " << id << " doesn't exist" << std::endl;
-                    continue;
-                }
-                message m = {ExecAdd, id, val, key};
-                saved_mes.push_back(m);
-                Node* target = searchChild(children_root, id);
-                if (target)
-                    send_mes(*target, m);
-                else
-                    std::cout << "Error: Node with id " << id << " is not directly accessible" << std::endl;
+                std::string_view blob(words[3].data(), line.data() + line.size() - words[3].data());
+                blob = blob.substr(0, blob.find_last_not_of(" \t\r") + 1);
+                ops.push_back({ExecAdd, 0, key, true, std::string(blob)});
             }
-            else if (sscanf(input_line, "%d %30s", &id, key) == 2)
+            ++exec_ops;
+            if (ops.size() == BATCH_MAX)
+                flushBatches();
+        }
+        else if (command == "del")
+        {
+            // del id key
+            int id;
+            if (words.size() < 3 || !parseInt(words[1], id) || !nodeExists(id))
+                return;
+            std::vector<ExecOp>& ops = batches[id];
+            ops.push_back({ExecDel, 0, std::string(words[2]), false, {}});
+            ++exec_ops;
+            if (ops.size() == BATCH_MAX)
+                flushBatches();
+        }
+        else if (command == "put" || command == "get" || command == "remove")
+        {
+            // Кластерные команды: put key value | get key | remove key; узлы для
+            // ключа выбирает кольцо, значение — целое или блоб, как в exec
+            if (words.size() < (command == "put" ? 3u : 2u))
+                return;
+            if (ring.size() == 0)
+            {
+                std::cout << "Error: Cluster has no nodes" << '\n';
+                return;
+            }
+            uint64_t tag = next_op++;
+            ClusterOp op;
+            op.key = std::string(words[1]);
+            op.replicas = ring.replicas(op.key, replication);
+            if (command == "get")
             {
-                if (!all_id.count(id))
+                // Чтения начинаются с разных реплик по очереди, чтобы распределить нагрузку
+                op.command = ExecFnd;
+                op.needed = std::min(read_quorum, op.replicas.size());
+                std::rotate(op.replicas.begin(), op.replicas.begin() + read_rotation++ % op.replicas.size(),
+                            op.replicas.end());
+                ClusterOp& stored = cluster_ops.emplace(tag, std::move(op)).first->second;
+                while (stored.outstanding < stored.needed && readNext(tag, stored))
+                    ;
+            }
+            else
+            {
+                std::string value;
+                int64_t number;
+                if (command == "remove")
                 {
-                    std::cout << "Error: Node with id " << id << " doesn't exist" << std::endl;
-                    continue;
+                    op.command = ExecDel;
+                    value = encodeVersioned(nextVersion(), VersionedDeleted, {});
+                }
+                else if (words.size() == 3 && parseInt(words[2], number))
+                {
+                    op.command = ExecAdd;
+                    value = encodeVersioned(nextVersion(), VersionedNumber, words[2]);
                 }
-                message m = {ExecFnd, id, -1, key};
-                saved_mes.push_back(m);
-                Node* target = searchChild(children_root, id);
-                if (target)
-                    send_mes(*target, m);
                 else
-                    std::cout << "Error: Node with id " << id << " is not directly accessible" << std::endl;
+                {
+                    std::string_view blob(words[2].data(), line.data() + line.size() - words[2].data());
+                    blob = blob.substr(0, blob.find_last_not_of(" \t\r") + 1);
+                    op.command = ExecAdd;
+                    value = encodeVersioned(nextVersion(), VersionedBlob, blob);
+                }
+                op.needed = std::min(write_quorum, op.replicas.size());
+                for (int node : op.replicas)
+                {
+                    if (down.count(node))
+                        continue;
+                    queueMerge(node, op.key, value, tag);
+                    ++op.outstanding;
+                }
+                cluster_used = true;
+                cluster_ops.emplace(tag, std::move(op));
             }
+            ++exec_ops;
+            // Без достаточного числа доступных реплик ошибка выводится сразу
+            settle(cluster_ops.find(tag));
+            if (batch_full)
+                flushBatches();
         }
-        else if (command == "ping")
+        else if (command == "scan" || command == "range")
         {
+            // scan id prefix [limit] | range id from to [limit]
+            bool range = command == "range";
+            size_t needed = range ? 4 : 3;
             int id;
-            std::cin >> id;
-            if (!all_id.count(id))
+            int64_t limit = 0;
+            if (words.size() < needed || !parseInt(words[1], id) || !nodeExists(id))
+                return;
+            if (words.size() > needed && !parseInt(words[needed], limit))
+                return;
+            message m(range ? ExecRange : ExecScan, id, limit, std::string(words[2]));
+            if (range)
+                m.value = std::string(words[3]);
+            // Скан должен видеть все предыдущие exec к этому узлу
+            flushBatches();
+            sendTo(id, m);
+        }
+        else if (command == "stats")
+        {
+            // stats id — счётчики узла, запрос идёт по дереву; stats -1 — управляющего
+            int id;
+            if (words.size() < 2 || !parseInt(words[1], id))
+                return;
+            if (id == -1)
+                printStats(-1, formatMetrics(nodeMetrics()) + "queues: requests " + std::to_string(pending.size())
+                                   + '\n');
+            else if (nodeExists(id))
             {
-                std::cout << "Error: Node with id " << id << " doesn't exist" << std::endl;
+                flushBatches();
+                sendTo(id, message(Stats, id, 0));
             }
+        }
+        else if (command == "trace")
+        {
+            if (words.size() > 1 && (words[1] == "on" || words[1] == "off"))
+                tracing = words[1] == "on";
+            else
+                std::cout << "Error: trace on|off" << '\n';
+        }
+        else if (command == "ping")
+        {
+            int id;
+            if (sscanf(input_line, "%d", &id) != 1)
+                return;
+            if (down.count(id))
+                std::cout << "Error:" << id << " is unavailable" << '\n';
+            else if (!all_id.count(id))
+                std::cout << "Error: Node with id " << id << " doesn't exist" << '\n';
             else
             {
-                message m(Ping, id, 0);
-                saved_mes.push_back(m);
-                Node* target = searchChild(children_root, id);
-                if (target)
-                    send_mes(*target, m);
-                else
-                    std::cout << "Error: Node with id " << id << " is not directly accessible" << std::endl;
+                flushBatches();
+                sendTo(id, message(Ping, id, 0));
             }
         }
         else if (command == "heartbeat")
         {
-            // Устанавливаем новый интервал heartbeat и рассылаем его всем прямым детям
-            handle_heartbeat_command(children_root);
+            // Устанавливаем новый интервал heartbeat и рассылаем его всем прямым детям;
+            // heartbeat stats — задержка heartbeat и число недоступных узлов
+            int time;
+            if (sscanf(input_line, "%d", &time) == 1)
+                handle_heartbeat_command(children, time);
+            else if (words.size() > 1 && words[1] == "stats")
+                print_beat_stats(std::cout);
         }
         else
-            std::cout << "Error: Command doesn't exist!" << std::endl;
-        usleep(1000000);
+            std::cout << "Error: Command doesn't exist!" << '\n';
+    };
+
+    // Цикл событий: процесс спит в zmq_poll, пока не придёт ответ от ребёнка,
+    // строка ввода или не наступит срок ожидающего сообщения / проверки heartbeat.
+    // После конца ввода работа продолжается, пока есть ожидающие ответы.
+    // В режиме нагрузки файл читается без ожидания, пока в полёте меньше WINDOW
+    // запросов; create дожидается подтверждения, прежде чем читать дальше.
+    std::string input_buffer;
+    std::vector<std::string> lines;
+    size_t next_line = 0;
+    bool input_open = true;
+    auto start = std::chrono::steady_clock::now();
+    auto inputBlocked = [&] {
+        return workload && (!pending.creating.empty() || pending.size() >= WINDOW);
+    };
+    while (input_open || next_line < lines.size() || !pending.empty())
+    {
+        std::cout.flush();
+        zmq_pollitem_t items[3];
+        int count = 0, input_index = -1, router_index = -1;
+        int exit_index = count;
+        items[count++] = {nullptr, childExitFd(), ZMQ_POLLIN, 0};
+        if (input_open && !workload && next_line == lines.size())
+        {
+            input_index = count;
+            items[count++] = {nullptr, STDIN_FILENO, ZMQ_POLLIN, 0};
+        }
+        if (router)
+        {
+            router_index = count;
+            items[count++] = {router, 0, ZMQ_POLLIN, 0};
+        }
+
+        long timeout = pending.deadlines.msUntilNext(std::chrono::steady_clock::now());
+        // Отложенное в outbox детей досылается с повтором через 1 мс
+        if (flushOutboxes(children) && (timeout < 0 || timeout > 1))
+            timeout = 1;
+        // Проверяем heartbeat: пропустившие его узлы считаются недоступными,
+        // зависшие прямые дети завершаются и перезапускаются
+        long beats_timeout = check_beats(markDown);
+        killHungChildren(children, heartbeatInterval());
+        if (timeout < 0 || (beats_timeout >= 0 && beats_timeout < timeout))
+            timeout = beats_timeout;
+        if (!inputBlocked() && (next_line < lines.size() || (workload && input_open)))
+            timeout = 0;
+        if (zmq_poll(items, count, timeout) == -1 && errno != EINTR)
+        {
+            std::cerr << "zmq_poll failed" << std::endl;
+            return 1;
+        }
+
+        // Забираем все накопившиеся ответы прямых детей
+        if (router_index >= 0 && (items[router_index].revents & ZMQ_POLLIN))
+        {
+            message m;
+            int from;
+            auto received = std::chrono::steady_clock::now();
+            while ((m = get_mes_from(router, from)).command != None)
+            {
+                Node* child = children.find(from);
+                if (!child)
+                    continue;
+                child->last_seen = received;
+                returnCredit(*child, m.command, m.corr);
+                handleReply(m, child);
+                if (m.flags & WIRE_TRACE)
+                    std::cout << formatTrace(m.trace, traceNow()) << '\n';
+            }
+        }
+
+        // Упавшие прямые дети: всё их поддерево недоступно до перезапуска
+        if (items[exit_index].revents & ZMQ_POLLIN)
+        {
+            handleChildExits(children, heartbeatInterval(), [&](Node& child, const std::vector<uint64_t>& lost) {
+                for (int id : routes.reachableVia(&child))
+                    markDown(id);
+                for (uint64_t corr : lost)
+                {
+                    message request;
+                    std::vector<uint64_t> tags;
+                    if (pending.take(corr, request, &tags))
+                        failRequest(request, tags);
+                }
+            });
+        }
+
+        // Проверяем недошедшие сообщения: срабатывают только истёкшие такты колеса
+        pending.deadlines.expire(std::chrono::steady_clock::now(), [&](uint64_t corr) {
+            message request;
+            std::vector<uint64_t> tags;
+            if (pending.take(corr, request, &tags))
+                failRequest(request, tags);
+        });
+        // Подтверждения и отказы create освобождают места для ждущих узлов
+        placeWaiting();
+
+        // Обрабатываем команды ввода (конец pipe-ввода zmq_poll сообщает как POLLERR)
+        if (next_line == lines.size() && input_open && !inputBlocked()
+            && (workload || (input_index >= 0 && (items[input_index].revents & (ZMQ_POLLIN | ZMQ_POLLERR)))))
+        {
+            lines.clear();
+            next_line = 0;
+            input_open = readInputLines(input_fd, input_buffer, lines);
+        }
+        while (next_line < lines.size() && !inputBlocked())
+            handleCommand(lines[next_line++]);
+        flushBatches();
+    }
+    std::cout.flush();
+    if (workload)
+    {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << "Operations: " << exec_ops << " in " << elapsed << " s (" << (uint64_t)(exec_ops / elapsed)
+                  << " ops/s)" << std::endl;
     }
     return 0;
 }
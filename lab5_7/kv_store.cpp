@@ -0,0 +1,228 @@
+#include "kv_store.h"
+#include <algorithm>
+#include <cstring>
+
+const char KvStore::TOMBSTONE_MARK = 0;
+
+const char* KvStore::Arena::store(std::string_view data)
+{
+    bytes_ += data.size();
+    char* out;
+    if (data.size() > BLOCK_SIZE / 4)
+    {
+        // Большая строка — в собственном блоке, текущий блок продолжает заполняться
+        blocks_.push_back(std::make_unique<char[]>(data.size()));
+        out = blocks_.back().get();
+    }
+    else
+    {
+        if (!current_ || used_ + data.size() > BLOCK_SIZE)
+        {
+            blocks_.push_back(std::make_unique<char[]>(BLOCK_SIZE));
+            current_ = blocks_.back().get();
+            used_ = 0;
+        }
+        out = current_ + used_;
+        used_ += data.size();
+    }
+    std::memcpy(out, data.data(), data.size());
+    return out;
+}
+
+KvStore::KvStore() : slots_(16) {}
+
+// Хэш по 8 байт за шаг с перемешиванием в конце (в духе wyhash/murmur3 fmix)
+uint64_t KvStore::hash_key(std::string_view key)
+{
+    const uint64_t M = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = key.size() * M;
+    const char* p = key.data();
+    size_t n = key.size();
+    while (n >= 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        h = (h ^ (w * 0xBF58476D1CE4E5B9ULL)) * M;
+        h ^= h >> 29;
+        p += 8;
+        n -= 8;
+    }
+    if (n > 0)
+    {
+        uint64_t w = 0;
+        std::memcpy(&w, p, n);
+        h = (h ^ (w * 0xBF58476D1CE4E5B9ULL)) * M;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+KvStore::Value KvStore::value_of(const Slot& slot)
+{
+    Value value;
+    if (slot.blob_size == NUMBER_VALUE)
+        value.number = slot.number;
+    else
+    {
+        value.is_blob = true;
+        value.blob = std::string_view(slot.blob, slot.blob_size);
+    }
+    return value;
+}
+
+// Ячейка с ключом или nullptr
+KvStore::Slot* KvStore::find_slot(std::string_view key, uint64_t hash) const
+{
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        const Slot& slot = slots_[i];
+        if (!slot.key)
+            return nullptr;
+        if (slot.hash == hash && slot.key != &TOMBSTONE_MARK && key_of(slot) == key)
+            return const_cast<Slot*>(&slot);
+    }
+}
+
+// Ячейка для ключа: существующая или новая (первое надгробие либо пустая)
+KvStore::Slot& KvStore::insert_slot(std::string_view key)
+{
+    maybe_rebuild();
+    uint64_t hash = hash_key(key);
+    size_t mask = slots_.size() - 1;
+    Slot* free_slot = nullptr;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        Slot& slot = slots_[i];
+        if (!slot.key)
+        {
+            if (!free_slot)
+                free_slot = &slot;
+            break;
+        }
+        if (slot.key == &TOMBSTONE_MARK)
+        {
+            if (!free_slot)
+                free_slot = &slot;
+            continue;
+        }
+        if (slot.hash == hash && key_of(slot) == key)
+        {
+            if (slot.blob_size != NUMBER_VALUE)
+                live_bytes_ -= slot.blob_size;
+            return slot;
+        }
+    }
+    if (free_slot->key == &TOMBSTONE_MARK)
+        --tombstones_;
+    free_slot->hash = hash;
+    free_slot->key = arena_.store(key);
+    free_slot->key_size = (uint32_t)key.size();
+    live_bytes_ += key.size();
+    ++size_;
+    return *free_slot;
+}
+
+void KvStore::put(std::string_view key, int64_t number)
+{
+    Slot& slot = insert_slot(key);
+    slot.blob_size = NUMBER_VALUE;
+    slot.number = number;
+}
+
+void KvStore::put_blob(std::string_view key, std::string_view blob)
+{
+    Slot& slot = insert_slot(key);
+    slot.blob_size = (uint32_t)blob.size();
+    slot.blob = arena_.store(blob);
+    live_bytes_ += blob.size();
+}
+
+bool KvStore::get(std::string_view key, Value& value) const
+{
+    Slot* slot = find_slot(key, hash_key(key));
+    if (!slot)
+        return false;
+    value = value_of(*slot);
+    return true;
+}
+
+bool KvStore::erase(std::string_view key)
+{
+    Slot* slot = find_slot(key, hash_key(key));
+    if (!slot)
+        return false;
+    live_bytes_ -= slot->key_size;
+    if (slot->blob_size != NUMBER_VALUE)
+        live_bytes_ -= slot->blob_size;
+    slot->key = &TOMBSTONE_MARK;
+    --size_;
+    ++tombstones_;
+    return true;
+}
+
+// Перестроение перед вставкой: рост при заполнении больше 70% (с надгробиями),
+// очистка надгробий и сжатие арены, когда мусора в ней больше половины
+void KvStore::maybe_rebuild()
+{
+    size_t capacity = slots_.size();
+    if ((size_ + tombstones_ + 1) * 10 > capacity * 7)
+    {
+        if ((size_ + 1) * 10 > capacity * 7 / 2)
+            capacity *= 2;
+        rebuild(capacity);
+    }
+    else if (arena_.bytes() > (1 << 20) && arena_.bytes() > 2 * live_bytes_)
+        rebuild(capacity);
+}
+
+void KvStore::rebuild(size_t capacity)
+{
+    std::vector<Slot> old(capacity);
+    old.swap(slots_);
+    Arena old_arena = std::move(arena_);
+    arena_ = Arena();
+    size_t mask = capacity - 1;
+    for (const Slot& slot : old)
+    {
+        if (!live(slot))
+            continue;
+        size_t i = slot.hash & mask;
+        while (slots_[i].key)
+            i = (i + 1) & mask;
+        Slot& moved = slots_[i];
+        moved = slot;
+        moved.key = arena_.store(key_of(slot));
+        if (slot.blob_size != NUMBER_VALUE)
+            moved.blob = arena_.store(std::string_view(slot.blob, slot.blob_size));
+    }
+    tombstones_ = 0;
+}
+
+std::vector<KvStore::Entry> KvStore::scan_prefix(std::string_view prefix, size_t limit) const
+{
+    std::vector<Entry> found;
+    for_each([&](const Entry& entry) {
+        if (entry.key.substr(0, prefix.size()) == prefix)
+            found.push_back(entry);
+    });
+    std::sort(found.begin(), found.end(), [](const Entry& a, const Entry& b) { return a.key < b.key; });
+    if (limit && found.size() > limit)
+        found.resize(limit);
+    return found;
+}
+
+std::vector<KvStore::Entry> KvStore::scan_range(std::string_view from, std::string_view to, size_t limit) const
+{
+    std::vector<Entry> found;
+    for_each([&](const Entry& entry) {
+        if (entry.key >= from && entry.key < to)
+            found.push_back(entry);
+    });
+    std::sort(found.begin(), found.end(), [](const Entry& a, const Entry& b) { return a.key < b.key; });
+    if (limit && found.size() > limit)
+        found.resize(limit);
+    return found;
+}
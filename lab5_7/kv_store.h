@@ -0,0 +1,96 @@
+#ifndef KV_STORE_H
+#define KV_STORE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Хранилище ключей узла: открытая адресация с линейным пробированием.
+// Ключи и блобы лежат подряд в арене (без отдельной аллокации на ключ), в ячейке —
+// хэш, указатель и длина, поэтому поиск по string_view ничего не выделяет и
+// обычно сравнивает только хэши. Удаление оставляет «надгробие»; надгробия и
+// мусор арены убираются при перестроении таблицы.
+class KvStore {
+public:
+    struct Value {
+        bool is_blob = false;
+        int64_t number = 0;
+        std::string_view blob;
+    };
+
+    struct Entry {
+        std::string_view key;
+        Value value;
+    };
+
+    KvStore();
+
+    void put(std::string_view key, int64_t number);
+    void put_blob(std::string_view key, std::string_view blob);
+    bool get(std::string_view key, Value& value) const;
+    bool erase(std::string_view key);
+    size_t size() const { return size_; }
+
+    // Ключи с префиксом prefix / из [from, to) по возрастанию; limit = 0 — без ограничения.
+    // Таблица неупорядочена, поэтому скан проходит её целиком и сортирует найденное.
+    std::vector<Entry> scan_prefix(std::string_view prefix, size_t limit = 0) const;
+    std::vector<Entry> scan_range(std::string_view from, std::string_view to, size_t limit = 0) const;
+
+    // Обход всех записей в порядке таблицы (для снимков)
+    template <typename F>
+    void for_each(F f) const {
+        for (const Slot& slot : slots_) {
+            if (live(slot))
+                f(Entry{key_of(slot), value_of(slot)});
+        }
+    }
+
+private:
+    static const uint32_t NUMBER_VALUE = UINT32_MAX; // blob_size для целого значения
+
+    struct Slot {
+        uint64_t hash;
+        const char* key; // nullptr — пусто, TOMBSTONE — удалено
+        uint32_t key_size;
+        uint32_t blob_size;
+        union {
+            int64_t number;
+            const char* blob;
+        };
+    };
+
+    // Арена: блоки по 64 КБ, большие строки — в отдельном блоке
+    class Arena {
+    public:
+        const char* store(std::string_view data);
+        size_t bytes() const { return bytes_; }
+
+    private:
+        static const size_t BLOCK_SIZE = 1 << 16;
+        std::vector<std::unique_ptr<char[]>> blocks_;
+        char* current_ = nullptr;
+        size_t used_ = 0;
+        size_t bytes_ = 0;
+    };
+
+    static const char TOMBSTONE_MARK;
+    static bool live(const Slot& slot) { return slot.key && slot.key != &TOMBSTONE_MARK; }
+    static std::string_view key_of(const Slot& slot) { return {slot.key, slot.key_size}; }
+    static Value value_of(const Slot& slot);
+    static uint64_t hash_key(std::string_view key);
+
+    Slot* find_slot(std::string_view key, uint64_t hash) const;
+    Slot& insert_slot(std::string_view key);
+    void rebuild(size_t capacity);
+    void maybe_rebuild();
+
+    std::vector<Slot> slots_;
+    Arena arena_;
+    size_t size_ = 0;
+    size_t tombstones_ = 0;
+    size_t live_bytes_ = 0; // байты арены, на которые ссылаются живые записи
+};
+
+#endif // KV_STORE_H
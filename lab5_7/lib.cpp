@@ -1,20 +1,46 @@
 #include "lib.h"
+#include "node.h"
+#include "metrics.h"
+#include "timer_wheel.h"
+#include "hdr_histogram.h"
 #include <fcntl.h>   // Для fcntl, O_NONBLOCK
 #include <errno.h>
 #include <signal.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <chrono>
+#include <algorithm>
 
-// Функция проверки ввода
-bool inputAvailable()
+// Чтение доступного ввода без блокировки сверх одного read: вызывается, когда
+// zmq_poll сообщил о готовности stdin (или файл нагрузки ещё не дочитан).
+// Полные строки добавляются в lines, незаконченный хвост остаётся в buffer.
+// Возвращает false при конце ввода.
+bool readInputLines(int fd, std::string& buffer, std::vector<std::string>& lines)
 {
-    struct timeval tv;
-    fd_set fds;
-    tv.tv_sec = 0;
-    tv.tv_usec = 0;
-    FD_ZERO(&fds);
-    FD_SET(STDIN_FILENO, &fds);
-    select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv);
-    return (FD_ISSET(STDIN_FILENO, &fds));
+    char chunk[65536];
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n <= 0)
+    {
+        if (!buffer.empty())
+            lines.push_back(buffer);
+        buffer.clear();
+        return false;
+    }
+    buffer.append(chunk, n);
+    size_t start = 0, end;
+    while ((end = buffer.find('\n', start)) != std::string::npos)
+    {
+        lines.push_back(buffer.substr(start, end - start));
+        start = end + 1;
+    }
+    buffer.erase(0, start);
+    return true;
 }
 
 std::time_t t_now()
@@ -22,141 +48,859 @@ std::time_t t_now()
     return std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 }
 
-Node createNode(int id, bool is_child)
+// Один контекст ZeroMQ (и одна пара его потоков ввода-вывода) на процесс
+void* sharedContext()
+{
+    static void* context = zmq_ctx_new();
+    return context;
+}
+
+// id узла, которому принадлежит поток: им помечаются трассируемые сообщения
+static thread_local int local_node_id = -1;
+
+// Узел текущего процесса: DEALER, подключённый к ROUTER родителя.
+// Routing id сокета — id узла в десятичной записи (двоичный id мог бы начинаться
+// с нулевого байта, а такие routing id ZeroMQ резервирует), по нему родитель отличает детей.
+Node createNode(int id, const std::string& parent_address)
 {
     Node node;
     node.id = id;
+    local_node_id = id;
     node.pid = getpid();
-
-    node.context = zmq_ctx_new();
+    node.context = sharedContext();
     node.socket = zmq_socket(node.context, ZMQ_DEALER);
+    std::string routing_id = std::to_string(id);
+    zmq_setsockopt(node.socket, ZMQ_ROUTING_ID, routing_id.data(), routing_id.size());
+    int hwm = flowLimits().hwm;
+    zmq_setsockopt(node.socket, ZMQ_SNDHWM, &hwm, sizeof(hwm));
+    zmq_setsockopt(node.socket, ZMQ_RCVHWM, &hwm, sizeof(hwm));
+    node.address = parent_address;
+    zmq_connect(node.socket, node.address.c_str());
+    node.ready = true;
+    return node;
+}
+
+// Транспорт для сокетов детей; дети наследуют его по адресу родителя
+static Transport current_transport = TransportTcp;
 
-    node.address = "tcp://127.0.0.1:" + std::to_string(5555 + id);
+void setTransport(Transport transport)
+{
+    current_transport = transport;
+    if (transport != TransportInproc)
+        return;
+    // Узлы-потоки: у каждого свои сокеты в общем контексте, а их по умолчанию
+    // не больше 1023; дескрипторов (eventfd на сокет) — сколько разрешено
+    zmq_ctx_set(sharedContext(), ZMQ_MAX_SOCKETS, zmq_ctx_get(sharedContext(), ZMQ_SOCKET_LIMIT));
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max)
+    {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+}
 
-    if (is_child)
-        zmq_connect(node.socket, (node.address).c_str());
+bool parseTransport(const std::string& name, Transport& transport)
+{
+    if (name == "tcp")
+        transport = TransportTcp;
+    else if (name == "ipc")
+        transport = TransportIpc;
+    else if (name == "inproc")
+        transport = TransportInproc;
     else
-        zmq_bind(node.socket, (node.address).c_str());
+        return false;
+    return true;
+}
 
-    return node;
+Transport transportOf(const std::string& address)
+{
+    if (address.rfind("ipc://", 0) == 0)
+        return TransportIpc;
+    if (address.rfind("inproc://", 0) == 0)
+        return TransportInproc;
+    return TransportTcp;
+}
+
+// Каталог данных, число обработчиков и пределы потока передаются детям
+// аргументами — наследуются, как и транспорт
+static std::string data_dir;
+static int node_workers = 1;
+static SpawnMode spawn_mode = SpawnPosix;
+static FlowLimits flow_limits;
+
+void setDataDir(const std::string& dir)
+{
+    data_dir = dir;
 }
 
-Node createProcess(int id)
+const std::string& dataDir()
 {
-    pid_t pid = fork();
-    if (pid == 0)
+    return data_dir;
+}
+
+void setNodeWorkers(int workers)
+{
+    node_workers = workers;
+}
+
+int nodeWorkers()
+{
+    return node_workers;
+}
+
+void setSpawnMode(SpawnMode mode)
+{
+    spawn_mode = mode;
+}
+
+const FlowLimits& flowLimits()
+{
+    return flow_limits;
+}
+
+bool parseFlowOption(const std::string& option, const std::string& value)
+{
+    char* end;
+    long long number = strtoll(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || number <= 0 || number > INT32_MAX)
+        return false;
+    if (option == "--hwm")
+        flow_limits.hwm = (int)number;
+    else if (option == "--outbox")
+        flow_limits.outbox = (size_t)number;
+    else if (option == "--window")
+        flow_limits.window = (size_t)number;
+    else
+        return false;
+    return true;
+}
+
+bool parseSpawnMode(const std::string& name, SpawnMode& mode)
+{
+    if (name == "posix")
+        mode = SpawnPosix;
+    else if (name == "fork")
+        mode = SpawnFork;
+    else
+        return false;
+    return true;
+}
+
+// Единственный ROUTER узла, к которому подключаются все его дети; создаётся при
+// появлении первого ребёнка. Он thread_local: в процессе-узле поток цикла один,
+// а у узлов-потоков одного процесса ROUTER у каждого свой. TCP-порт выбирает система (bind на
+// «*»), ipc — сокет в абстрактном пространстве имён Linux (файл не остаётся после
+// аварии), inproc — для узлов-потоков одного процесса. Фактический адрес берётся
+// из ZMQ_LAST_ENDPOINT и передаётся ребёнку при запуске.
+void* childrenSocket(int id, std::string& address)
+{
+    static thread_local void* router = nullptr;
+    static thread_local std::string router_address;
+    if (!router)
     {
-        // Дочерний процесс
-        execl("./computing", "computing", std::to_string(id).c_str(), NULL);
-        std::cerr << "execl failed" << std::endl;
+        router = zmq_socket(sharedContext(), ZMQ_ROUTER);
+        // Сообщение неподключённому ребёнку — ошибка, а не молчаливая потеря
+        int mandatory = 1;
+        zmq_setsockopt(router, ZMQ_ROUTER_MANDATORY, &mandatory, sizeof(mandatory));
+        // Перезапущенный ребёнок подключается с тем же routing id, пока старое
+        // соединение ещё не закрыто: новое должно его заменить, а не отвергаться
+        int handover = 1;
+        zmq_setsockopt(router, ZMQ_ROUTER_HANDOVER, &handover, sizeof(handover));
+        zmq_setsockopt(router, ZMQ_SNDHWM, &flow_limits.hwm, sizeof(flow_limits.hwm));
+        zmq_setsockopt(router, ZMQ_RCVHWM, &flow_limits.hwm, sizeof(flow_limits.hwm));
+        std::string endpoint;
+        switch (current_transport)
+        {
+        case TransportIpc:
+            endpoint = "ipc://@lab5_7-" + std::to_string(getpid());
+            break;
+        case TransportInproc:
+            endpoint = "inproc://lab5_7-" + std::to_string(id);
+            break;
+        default:
+            endpoint = "tcp://127.0.0.1:*";
+            break;
+        }
+        if (zmq_bind(router, endpoint.c_str()) == -1)
+        {
+            std::cerr << "Bind " << endpoint << " failed: " << zmq_strerror(errno) << std::endl;
+            exit(1);
+        }
+        char last_endpoint[256];
+        size_t size = sizeof(last_endpoint);
+        zmq_getsockopt(router, ZMQ_LAST_ENDPOINT, last_endpoint, &size);
+        router_address = last_endpoint;
+    }
+    address = router_address;
+    return router;
+}
+
+// Процесс computing для узла id, подключающийся к address.
+//
+// По умолчанию — posix_spawn: glibc запускает его через clone(CLONE_VM | CLONE_VFORK),
+// без копирования таблиц страниц родителя, поэтому цена не растёт с размером
+// словаря и числом детей. В таком ребёнке нельзя выполнить prctl до exec, так
+// что PDEATHSIG ставит сам computing первым делом, а --parent с pid родителя
+// закрывает гонку: если родитель умер раньше, getppid() уже не совпадёт.
+// Маска сигналов переживает exec, поэтому SIGCHLD (его ждёт signalfd родителя)
+// в ребёнке снова разблокируется. Аргументы собираются до запуска: после fork
+// в многопоточном процессе выделять память нельзя.
+static pid_t spawnComputing(int id, const std::string& address)
+{
+    std::string id_arg = std::to_string(id);
+    std::string workers_arg = std::to_string(node_workers);
+    std::string parent_arg = std::to_string(getpid());
+    std::string hwm_arg = std::to_string(flow_limits.hwm);
+    std::string outbox_arg = std::to_string(flow_limits.outbox);
+    std::string window_arg = std::to_string(flow_limits.window);
+    std::vector<const char*> args = {"computing", id_arg.c_str(), address.c_str(), "--parent", parent_arg.c_str(),
+                                     "--workers", workers_arg.c_str(), "--hwm", hwm_arg.c_str(),
+                                     "--outbox", outbox_arg.c_str(), "--window", window_arg.c_str()};
+    if (!data_dir.empty())
+    {
+        args.push_back("--data-dir");
+        args.push_back(data_dir.c_str());
+    }
+    if (spawn_mode == SpawnFork)
+    {
+        args.push_back("--spawn");
+        args.push_back("fork");
+    }
+    args.push_back(nullptr);
+    sigset_t mask;
+    pthread_sigmask(SIG_BLOCK, nullptr, &mask);
+    sigdelset(&mask, SIGCHLD);
+
+    pid_t pid;
+    if (spawn_mode == SpawnFork)
+    {
+        pid = fork();
+        if (pid == 0)
+        {
+            // Дочерний процесс; завершается вместе с родителем, чтобы не оставлять «сирот»
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            sigprocmask(SIG_SETMASK, &mask, nullptr);
+            execv("./computing", (char* const*)args.data());
+            _exit(1);
+        }
+        if (pid == -1)
+        {
+            std::cerr << "Fork failed" << std::endl;
+            exit(1);
+        }
+        return pid;
+    }
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+    int rc = posix_spawn(&pid, "./computing", nullptr, &attr, (char* const*)args.data(), environ);
+    posix_spawnattr_destroy(&attr);
+    if (rc != 0)
+    {
+        std::cerr << "posix_spawn failed: " << strerror(rc) << std::endl;
         exit(1);
     }
-    else if (pid == -1)
+    return pid;
+}
+
+// Вызывается computing до всего остального: узел завершается вместе с родителем
+bool watchParent(pid_t parent)
+{
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    return getppid() == parent;
+}
+
+// Узлы-потоки (транспорт inproc): флаг остановки каждого. Остановка имитирует
+// отказ узла для замеров обнаружения отказов — процесс убить можно, поток нет
+static std::mutex node_threads_mutex;
+static std::unordered_map<int, std::shared_ptr<std::atomic<bool>>> node_threads;
+static thread_local std::shared_ptr<std::atomic<bool>> node_stop;
+
+struct NodeThreadStart {
+    int id;
+    std::string address;
+    std::shared_ptr<std::atomic<bool>> stop;
+};
+
+static void* nodeThreadMain(void* arg)
+{
+    std::unique_ptr<NodeThreadStart> start((NodeThreadStart*)arg);
+    node_stop = start->stop;
+    runNode(start->id, start->address);
+    return nullptr;
+}
+
+// Стек меньше стандартных 8 МБ: потоков-узлов тысячи, а цикл узла неглубокий
+static void startNodeThread(int id, const std::string& address)
+{
+    auto start = std::make_unique<NodeThreadStart>();
+    start->id = id;
+    start->address = address;
+    start->stop = std::make_shared<std::atomic<bool>>(false);
+    {
+        std::lock_guard<std::mutex> lock(node_threads_mutex);
+        node_threads[id] = start->stop;
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 512 * 1024);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int rc = pthread_create(&thread, &attr, nodeThreadMain, start.get());
+    pthread_attr_destroy(&attr);
+    if (rc != 0)
     {
-        std::cerr << "Fork failed" << std::endl;
+        std::cerr << "Node thread failed: " << strerror(rc) << std::endl;
         exit(1);
     }
-    Node node = createNode(id, false);
-    node.pid = pid;
+    start.release();
+}
+
+bool nodeStopped()
+{
+    return node_stop && node_stop->load(std::memory_order_relaxed);
+}
+
+void stopNodeThread(int id)
+{
+    std::lock_guard<std::mutex> lock(node_threads_mutex);
+    auto it = node_threads.find(id);
+    if (it != node_threads.end())
+        it->second->store(true, std::memory_order_relaxed);
+}
+
+// Запуск вычислительного узла id ребёнком узла parent_id: процесс computing или,
+// при транспорте inproc, поток в этом процессе (pid -1: его не ждёт waitpid и не
+// завершает killHungChildren). Узел не готов, пока не пришлёт своё подтверждение
+// Create; до этого сообщения копятся в outbox.
+Node createProcess(int parent_id, int id)
+{
+    std::string address;
+    void* router = childrenSocket(parent_id, address);
+    childExitFd();
+    Node node;
+    node.id = id;
+    if (current_transport == TransportInproc)
+    {
+        startNodeThread(id, address);
+        node.pid = -1;
+    }
+    else
+        node.pid = spawnComputing(id, address);
+    node.context = sharedContext();
+    node.socket = router;
+    node.address = address;
+    node.via_router = true;
+    node.last_seen = std::chrono::steady_clock::now();
     return node;
 }
 
-void send_mes(Node &node, message m)
+// Дескриптор для zmq_poll, готовый к чтению, когда завершился кто-то из детей:
+// signalfd на SIGCHLD (сигнал блокируется, чтобы приходить только через него)
+int childExitFd()
+{
+    static int fd = -1;
+    if (fd == -1)
+    {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &mask, nullptr);
+        fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    }
+    return fd;
+}
+
+// Снятие завершившихся детей. Для каждого вызывается on_down (пока маршруты
+// через него ещё на месте), затем ребёнок перезапускается с тем же id: новый
+// процесс подключается к тому же ROUTER, а в outbox до его подтверждения лежат
+// Create его поддерева и текущий интервал heartbeat. Упавший до подключения
+// ребёнок не перезапускается, чтобы не зациклиться на ошибке запуска.
+void handleChildExits(const ChildTable& children, std::chrono::milliseconds heartbeat,
+                      const std::function<void(Node&, const std::vector<uint64_t>&)>& on_down)
+{
+    signalfd_siginfo info;
+    while (read(childExitFd(), &info, sizeof(info)) == sizeof(info))
+        ;
+    pid_t pid;
+    while ((pid = waitpid(-1, nullptr, WNOHANG)) > 0)
+    {
+        auto it = std::find_if(children.begin(), children.end(), [&](const Node* node) { return node->pid == pid; });
+        if (it == children.end())
+            continue;
+        Node* child = *it;
+        // Запросы, ушедшие в упавший процесс или ждавшие в его outbox, ответа не
+        // получат: о каждом сообщается выше, окно открывается заново
+        std::vector<uint64_t> lost(child->in_flight.begin(), child->in_flight.end());
+        child->in_flight.clear();
+        on_down(*child, lost);
+        if (!child->ready)
+        {
+            child->pid = -1;
+            continue;
+        }
+        std::cerr << "Node " << child->id << " exited, restarting" << std::endl;
+        child->ready = false;
+        child->outbox.assign(child->subtree_creates.begin(), child->subtree_creates.end());
+        if (heartbeat.count() > 0)
+            child->outbox.push_back(message(HeartBeat, -1, heartbeat.count()));
+        child->pid = spawnComputing(child->id, child->address);
+        child->last_seen = std::chrono::steady_clock::now();
+    }
+}
+
+// Подключённые дети, молчащие дольше 4 интервалов heartbeat, считаются
+// зависшими и завершаются; дальше их перезапускает handleChildExits
+void killHungChildren(const ChildTable& children, std::chrono::milliseconds interval)
 {
+    if (interval.count() == 0)
+        return;
+    auto current = std::chrono::steady_clock::now();
+    for (Node* child : children)
+    {
+        if (child->ready && child->pid > 0 && current - child->last_seen > 4 * interval)
+        {
+            std::cerr << "Node " << child->id << " is not responding, killing it" << std::endl;
+            kill(child->pid, SIGKILL);
+            child->last_seen = current;
+        }
+    }
+}
+
+// Отправка первым кадром routing id ребёнка, если узел за общим ROUTER.
+// С ROUTER_MANDATORY ошибка — только здесь: EHOSTUNREACH, если ребёнок не
+// подключён, EAGAIN, если его очередь полна; остальные кадры уже не отвергаются
+static bool send_envelope(Node& node)
+{
+    if (!node.via_router)
+        return true;
+    std::string routing_id = std::to_string(node.id);
+    return zmq_send(node.socket, routing_id.data(), routing_id.size(), ZMQ_SNDMORE | ZMQ_DONTWAIT) != -1;
+}
+
+// Отправка без ожидания; false — сокет не принял сообщение, оно не ушло
+static bool send_now(Node& node, const message& m)
+{
+    if (!send_envelope(node))
+        return false;
+    MessageView view;
+    view.command = m.command;
+    view.id = m.id;
+    view.num = m.num;
+    view.key = m.st;
+    view.corr = m.corr;
+    view.value = m.value;
+    view.trace = m.trace;
+    view.flags = m.flags & ~WIRE_MORE;
+    // Кодируем сразу в буфер кадра
     zmq_msg_t request_message;
-    zmq_msg_init_size(&request_message, sizeof(m));
-    std::memcpy(zmq_msg_data(&request_message), &m, sizeof(m));
-    zmq_msg_send(&request_message, node.socket, ZMQ_DONTWAIT);
+    zmq_msg_init_size(&request_message, wire_size(view));
+    wire_encode(view, (char*)zmq_msg_data(&request_message));
+    if (zmq_msg_send(&request_message, node.socket, ZMQ_DONTWAIT) == -1)
+    {
+        zmq_msg_close(&request_message);
+        return false;
+    }
+    ++nodeMetrics().out[view.command % NodeMetrics::COMMANDS];
+    return true;
 }
 
-message get_mes(Node &node)
+// Сообщение ждёт в outbox; полный outbox — отказ, память узла не растёт
+static SendResult enqueue(Node& node, message m)
 {
-    zmq_msg_t request;
-    zmq_msg_init(&request);
-    auto result = zmq_msg_recv(&request, node.socket, ZMQ_DONTWAIT);
-    if (result == -1)
-        return message(None, -1, -1);
-    message m;
-    std::memcpy(&m, zmq_msg_data(&request), sizeof(message));
-    return m;
+    if (node.outbox.size() >= flow_limits.outbox)
+    {
+        ++nodeMetrics().busy;
+        return SendBusy;
+    }
+    if (node.ready)
+        ++nodeMetrics().queued;
+    node.outbox.push_back(std::move(m));
+    return SendQueued;
 }
 
-void traverseChildren(Node* root, const std::function<void(Node&)>& f) {
-    if (!root)
+// Раньше send_mes ждал в zmq_send, а ROUTER молча терял сообщения сверх HWM.
+// Теперь отправка не блокирует: что не принял сокет, ждёт в outbox, пока его
+// не дошлёт flushOutbox, а за пределом outbox вызывающий получает SendBusy
+SendResult send_mes(Node &node, message m)
+{
+    if (!node.ready || !node.outbox.empty() || !send_now(node, m))
+        return enqueue(node, std::move(m));
+    return SendOk;
+}
+
+// Пересылка принятого сообщения без перекодирования: кадр передаётся как есть.
+// Только трассируемое сообщение перекодируется, чтобы дописать отметку узла
+SendResult forward_mes(Node& node, Incoming& in)
+{
+    if (in.view.flags & WIRE_TRACE)
+    {
+        message m = in.toMessage();
+        traceHop(m.trace, local_node_id);
+        return send_mes(node, std::move(m));
+    }
+    if (!node.ready || !node.outbox.empty() || !send_envelope(node))
+        return enqueue(node, in.toMessage());
+    bool more = in.view.flags & WIRE_MORE;
+    zmq_msg_t copy;
+    zmq_msg_init(&copy);
+    zmq_msg_copy(&copy, &in.frame);
+    if (zmq_msg_send(&copy, node.socket, (more ? ZMQ_SNDMORE : 0) | ZMQ_DONTWAIT) == -1)
+    {
+        // DEALER отвергает сообщение целиком на первом кадре
+        zmq_msg_close(&copy);
+        return enqueue(node, in.toMessage());
+    }
+    ++nodeMetrics().out[in.view.command % NodeMetrics::COMMANDS];
+    if (more)
+    {
+        zmq_msg_init(&copy);
+        zmq_msg_copy(&copy, &in.extra);
+        if (zmq_msg_send(&copy, node.socket, ZMQ_DONTWAIT) == -1)
+            zmq_msg_close(&copy);
+    }
+    return SendOk;
+}
+
+bool flushOutbox(Node& node)
+{
+    while (node.ready && !node.outbox.empty())
+    {
+        if (!send_now(node, node.outbox.front()))
+            return false;
+        node.outbox.pop_front();
+    }
+    return node.outbox.empty();
+}
+
+bool flushOutboxes(const ChildTable& children)
+{
+    bool waiting = false;
+    for (Node* child : children)
+    {
+        if (!child->outbox.empty() && !flushOutbox(*child))
+            waiting = true;
+    }
+    return waiting;
+}
+
+// Ребёнок подключился: отправляем накопленное
+void markReady(Node& node)
+{
+    if (node.ready)
         return;
-    traverseChildren(root->left, f);
-    f(*root);
-    traverseChildren(root->right, f);
+    node.ready = true;
+    flushOutbox(node);
+}
+
+// Запросы, ответ на которые возвращается через того же ребёнка. Create сюда
+// не входит: его подтверждение шлёт новый узел и после перезапуска без запроса
+static bool isRequest(uint8_t command)
+{
+    switch (command)
+    {
+    case Ping:
+    case ExecAdd:
+    case ExecFnd:
+    case ExecDel:
+    case ExecMerge:
+    case ExecScan:
+    case ExecRange:
+    case Batch:
+    case Stats:
+        return true;
+    default:
+        return false;
+    }
 }
 
-Node* insertChild(Node* root, Node* newChild) {
-    if (root == nullptr)
-        return newChild;
-    if (newChild->id < root->id)
-        root->left = insertChild(root->left, newChild);
-    else if (newChild->id > root->id)
-        root->right = insertChild(root->right, newChild);
-    return root;
+void releaseCredit(Node& child, uint64_t corr)
+{
+    auto it = child.in_flight.find(corr);
+    if (it != child.in_flight.end())
+        child.in_flight.erase(it);
 }
 
+void returnCredit(Node& child, uint8_t command, uint64_t corr)
+{
+    bool reply = command == ExecErr || command == Busy || command == Unavailable
+                 || (isRequest(command) && command != ExecRange);
+    if (reply)
+        releaseCredit(child, corr);
+}
 
-// Внутренние статические переменные для heartbeat
+// Пропуск оставшихся кадров испорченного сообщения
+static void skip_frames(void* socket, zmq_msg_t& frame)
+{
+    while (zmq_msg_more(&frame))
+        zmq_msg_recv(&frame, socket, ZMQ_DONTWAIT);
+}
+
+// Приём очередного сообщения без блокировки; false — сообщений больше нет.
+// Кадры неизвестного формата или версии пропускаются.
+bool recv_mes(void* socket, Incoming& in, bool from_router)
+{
+    while (true)
+    {
+        if (from_router)
+        {
+            if (zmq_msg_recv(&in.frame, socket, ZMQ_DONTWAIT) == -1)
+                return false;
+            size_t size = std::min(zmq_msg_size(&in.frame), (size_t)15);
+            char routing_id[16];
+            std::memcpy(routing_id, zmq_msg_data(&in.frame), size);
+            routing_id[size] = '\0';
+            in.from = atoi(routing_id);
+            if (zmq_msg_recv(&in.frame, socket, ZMQ_DONTWAIT) == -1)
+                return false;
+        }
+        else if (zmq_msg_recv(&in.frame, socket, ZMQ_DONTWAIT) == -1)
+            return false;
+
+        if (!wire_decode((const char*)zmq_msg_data(&in.frame), zmq_msg_size(&in.frame), in.view))
+        {
+            skip_frames(socket, in.frame);
+            continue;
+        }
+        if (in.view.flags & WIRE_MORE)
+        {
+            if (!zmq_msg_more(&in.frame) || zmq_msg_recv(&in.extra, socket, ZMQ_DONTWAIT) == -1)
+                continue;
+            in.view.value = std::string_view((const char*)zmq_msg_data(&in.extra), zmq_msg_size(&in.extra));
+            skip_frames(socket, in.extra);
+        }
+        else
+            skip_frames(socket, in.frame);
+        ++nodeMetrics().in[in.view.command % NodeMetrics::COMMANDS];
+        return true;
+    }
+}
+
+message Incoming::toMessage() const
+{
+    message m((com)view.command, (int)view.id, view.num, std::string(view.key));
+    m.flags = view.flags & ~WIRE_MORE;
+    m.corr = view.corr;
+    m.value = std::string(view.value);
+    if (view.flags & WIRE_TRACE)
+        m.trace = std::string(view.trace);
+    return m;
+}
+
+message get_mes(Node &node)
+{
+    Incoming in;
+    if (!recv_mes(node.socket, in, false))
+        return message(None, -1, -1);
+    return in.toMessage();
+}
+
+// Сообщение от любого ребёнка из общего ROUTER; from_id — routing id отправителя
+message get_mes_from(void* router, int& from_id)
+{
+    Incoming in;
+    if (!recv_mes(router, in, true))
+        return message(None, -1, -1);
+    from_id = in.from;
+    return in.toMessage();
+}
+
+// Heartbeat на управляющем узле: для каждого узла — время последней сводки, в
+// которой он был. Сроки проверяет колесо таймеров; у узла в нём не больше одной
+// записи: при срабатывании срок пересчитывается от последнего heartbeat, так что
+// проверка не просматривает все узлы. Возраст heartbeat при получении — его
+// задержка, распределение копится в гистограмме (мкс).
+struct BeatState {
+    std::chrono::steady_clock::time_point generated; // когда узел отправил последний heartbeat
+    std::chrono::steady_clock::time_point last;      // когда этот heartbeat дошёл
+    bool missed = false;    // о недоступности уже сообщено
+    bool scheduled = false; // срок стоит в колесе
+};
 static std::chrono::milliseconds heartbeat_interval(0);
-static std::map<int, std::chrono::steady_clock::time_point> beat_tracker;
+static std::unordered_map<int, BeatState> beat_tracker;
+static TimerWheel<int> beat_deadlines(std::chrono::milliseconds(10), 1024);
+static LatencyHistogram beat_lag;
 
 // Вспомогательная функция, возвращающая текущее время (steady_clock)
 std::chrono::steady_clock::time_point now() {
     return std::chrono::steady_clock::now();
 }
 
-// Обновление времени последнего heartbeat для узла
-void update_beat(int node_id) {
-    beat_tracker[node_id] = now();
+std::chrono::milliseconds heartbeatInterval() {
+    return heartbeat_interval;
+}
+
+static void schedule_beat_deadline(int node_id, BeatState& state) {
+    if (state.scheduled || heartbeat_interval.count() == 0)
+        return;
+    beat_deadlines.schedule(state.last + 4 * heartbeat_interval, node_id);
+    state.scheduled = true;
+}
+
+// Обновление времени последнего heartbeat для узла; age_us — сколько heartbeat шёл.
+// Промежуточные узлы повторяют запись узла, пока она не устарела, поэтому новым
+// считается только heartbeat, отправленный заметно позже уже известного. Срок
+// отсчитывается от прихода: на глубине d сводка идёт до d интервалов.
+// Возвращает true для нового heartbeat.
+bool update_beat(int node_id, uint64_t age_us) {
+    BeatState& state = beat_tracker[node_id];
+    auto current = now();
+    auto generated = current - std::chrono::microseconds(age_us);
+    if (generated <= state.generated + heartbeat_interval / 2)
+        return false;
+    state.generated = generated;
+    state.last = current;
+    state.missed = false;
+    beat_lag.record(age_us);
+    schedule_beat_deadline(node_id, state);
+    return true;
+}
+
+// Сводка поддерева от прямого ребёнка sender; on_alive вызывается для каждого узла в ней
+void handle_beat_summary(std::string_view summary, int sender, const std::function<void(int)>& on_alive) {
+    if (summary.empty()) {
+        // Heartbeat без сводки — только сам отправитель
+        if (update_beat(sender, 0))
+            on_alive(sender);
+        return;
+    }
+    const char* pos = summary.data();
+    const char* end = pos + summary.size();
+    int64_t prev_id = 0, id;
+    uint64_t age_us;
+    while (beats_next(pos, end, prev_id, id, age_us)) {
+        if (update_beat((int)id, age_us))
+            on_alive((int)id);
+    }
 }
 
 // Функция обработки команды heartbeat:
-// Читает новый интервал с консоли, сохраняет его и рассылает сообщение  детям.
-void handle_heartbeat_command(Node* children_root) {
-    int time;
-    std::cin >> time;
+// Сохраняет новый интервал и рассылает сообщение детям.
+void handle_heartbeat_command(const ChildTable& children, int time) {
     heartbeat_interval = std::chrono::milliseconds(time);
     // Сброс времени для всех узлов
-    for (auto& kv : beat_tracker) {
-        kv.second = now();
+    for (auto& [id, state] : beat_tracker) {
+        state.last = now();
+        state.missed = false;
+        schedule_beat_deadline(id, state);
     }
     // Рассылка нового интервала детям
     message msg(HeartBeat, -1, time);
-    traverseChildren(children_root, [&](Node& child) {
-        send_mes(child, msg);
-    });
+    for (Node* child : children) {
+        child->last_seen = now();
+        send_mes(*child, msg);
+    }
 }
 
-// Функция проверки полученных heartbeat от узлов.
-// Сообщения о недоступности выводятся не чаще, чем раз в 5 секунд.
-void check_beats() {
-    static auto last_print_time = now();
+// Функция проверки сроков heartbeat: узел, не попавший ни в одну сводку за
+// 4 интервала, недоступен — сообщение выводится один раз, и вызывается on_missed.
+// Возвращает, через сколько миллисекунд её нужно вызвать снова (-1 — сроков нет).
+long check_beats(const std::function<void(int)>& on_missed) {
+    if (heartbeat_interval.count() == 0)
+        return -1;
     auto current = now();
-    auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(current - last_print_time).count();
-    if (diff < 5000) {
+    // Сначала собираем сработавшие: перепланирование внутри expire изменило бы ячейку
+    std::vector<int> expired;
+    beat_deadlines.expire(current, [&](int id) { expired.push_back(id); });
+    for (int id : expired) {
+        auto it = beat_tracker.find(id);
+        if (it == beat_tracker.end())
+            continue;
+        BeatState& state = it->second;
+        state.scheduled = false;
+        if (state.missed)
+            continue;
+        if (current - state.last >= 4 * heartbeat_interval) {
+            std::cout << "Node: " << id << " is unavailable now" << std::endl;
+            state.missed = true;
+            on_missed(id);
+        } else {
+            schedule_beat_deadline(id, state);
+        }
+    }
+    return beat_deadlines.msUntilNext(current);
+}
+
+// Сводка по heartbeat: число узлов, недоступные и перцентили задержки
+void print_beat_stats(std::ostream& out) {
+    size_t missed = 0;
+    for (const auto& [id, state] : beat_tracker)
+        missed += state.missed;
+    out << "Heartbeat: nodes " << beat_tracker.size() << ", missed " << missed << ", lag ms: p50 "
+        << beat_lag.percentile(50) / 1000.0 << ", p90 " << beat_lag.percentile(90) / 1000.0 << ", p99 "
+        << beat_lag.percentile(99) / 1000.0 << ", max " << beat_lag.max() / 1000.0 << '\n';
+}
+
+void BeatAggregator::merge(std::string_view summary, int sender, std::chrono::steady_clock::time_point at) {
+    auto record = [&](int id, uint64_t age_us) {
+        Info& info = nodes_[id];
+        auto generated = at - std::chrono::microseconds(age_us);
+        if (generated > info.generated)
+            info.generated = generated;
+        info.received = at;
+    };
+    if (summary.empty()) {
+        record(sender, 0);
         return;
     }
-    last_print_time = current;
-    for (auto& kv : beat_tracker) {
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(current - kv.second).count();
-        if (elapsed > 4 * heartbeat_interval.count()) {
-            std::cout << "Node: " << kv.first << " is unavailable now" << std::endl;
-            kv.second = current; // Сброс, чтобы избежать повторного вывода до следующего периода
+    const char* pos = summary.data();
+    const char* end = pos + summary.size();
+    int64_t prev_id = 0, id;
+    uint64_t age_us;
+    while (beats_next(pos, end, prev_id, id, age_us))
+        record((int)id, age_us);
+}
+
+std::string BeatAggregator::summary(int self_id, std::chrono::steady_clock::time_point at,
+                                    std::chrono::milliseconds window) {
+    std::string out;
+    int64_t prev_id = 0;
+    bool self_written = false;
+    for (auto it = nodes_.begin(); it != nodes_.end();) {
+        if (at - it->second.received > window) {
+            it = nodes_.erase(it);
+            continue;
+        }
+        if (!self_written && it->first > self_id) {
+            beats_append(out, prev_id, self_id, 0);
+            self_written = true;
+        }
+        auto age = std::chrono::duration_cast<std::chrono::microseconds>(at - it->second.generated);
+        beats_append(out, prev_id, it->first, age.count());
+        ++it;
+    }
+    if (!self_written)
+        beats_append(out, prev_id, self_id, 0);
+    return out;
+}
+
+// Отправка к узлу target по маршруту. Запрос берёт кредит у ребёнка: их не
+// больше FlowLimits::window, ответ кредит возвращает. Без кредита запрос сразу
+// отвергается — перегруженное поддерево не копит очередь у родителя. Без
+// маршрута (узел ещё не подтвердил создание или перезапускается) — тоже отказ
+// сразу, а не рассылка всем детям с ожиданием срока.
+template <typename Send>
+static SendResult route(const RoutingTable& routes, int target, uint8_t command, uint64_t corr, Send send) {
+    Node* via = routes.find(target);
+    if (via) {
+        bool request = isRequest(command);
+        if (request && via->in_flight.size() >= flow_limits.window) {
+            ++nodeMetrics().busy;
+            return SendBusy;
         }
+        SendResult result = send(*via);
+        if (request && result != SendBusy)
+            via->in_flight.insert(corr);
+        return result;
     }
+    return SendNoRoute;
+}
+
+SendResult forward(const RoutingTable& routes, int target, const message& m) {
+    return route(routes, target, m.command, m.corr, [&](Node& child) { return send_mes(child, m); });
 }
 
-Node* searchChild(Node* root, int id) {
-    if (root == nullptr)
-        return nullptr;
-    if (root->id == id)
-        return root;
-    Node* found = searchChild(root->left, id);
-    if (found)
-        return found;
-    return searchChild(root->right, id);
+SendResult forward(const RoutingTable& routes, int target, Incoming& in) {
+    return route(routes, target, in.view.command, in.view.corr, [&](Node& child) { return forward_mes(child, in); });
 }
@@ -1,3 +1,6 @@
+#ifndef LIB_H
+#define LIB_H
+
 #include <iostream>
 #include <list>
 #include <unordered_set>
@@ -8,11 +11,16 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include "zmq.h"
+#include "wire.h"
 #include <sys/select.h>
 #include <map>
+#include <deque>
+#include <unordered_map>
+#include <vector>
 #include <functional>
+#include <algorithm>
 
-bool inputAvailable();
+bool readInputLines(int fd, std::string& buffer, std::vector<std::string>& lines);
 std::time_t t_now();
 
 enum com : char {
@@ -22,18 +30,28 @@ enum com : char {
     ExecAdd = 3,
     ExecFnd = 4,
     ExecErr = 5,
-    HeartBeat = 6  // Новый тип сообщения для heartbeat
+    HeartBeat = 6, // Новый тип сообщения для heartbeat
+    Batch = 7,     // пакет ExecAdd/ExecFnd/ExecDel одному узлу, num — число операций
+    ExecDel = 8,   // удаление ключа, в ответе num = 1, если ключ был
+    ExecScan = 9,  // ключи с префиксом st (num — предел, 0 — все); ответ — ExecScan с записями
+    ExecRange = 10, // ключи из [st, value); ответ — ExecScan
+    Unavailable = 11, // узел id упал и перезапускается; шлёт его родитель управляющему узлу.
+                      // С corr — ответ на запрос, потерянный в упавшем узле или без
+                      // маршрута к id; num — отказавший узел
+    ExecMerge = 12,   // запись версионированного блоба (cluster.h), если он новее хранимого;
+                      // в ответе num = 1, если запись применена
+    Stats = 13,       // счётчики узла id; в ответе value — строки metrics.h
+    Busy = 14         // запрос к узлу id отвергнут: на пути к нему заполнены очередь или
+                      // окно кредитов; num — отказавший узел. Ответ вместо потери сообщения
 };
 
 class message {
 public:
     message() {}
-    message(com command, int id, int num)
+    message(com command, int id, int64_t num)
         : command(command), id(id), num(num), sent_time(t_now()) {}
-    message(com command, int id, int num, char s[])
-        : command(command), id(id), num(num), sent_time(t_now()) {
-        strncpy(st, s, 30);
-    }
+    message(com command, int id, int64_t num, const std::string& s)
+        : command(command), id(id), num(num), sent_time(t_now()), st(s) {}
 
     bool operator==(const message &other) const {
         return command == other.command && id == other.id && num == other.num;
@@ -41,9 +59,36 @@ public:
 
     com command;
     int id;
-    int num;
-    std::time_t sent_time;
-    char st[30];
+    int64_t num;
+    std::time_t sent_time; // только для ожидающих ответа, по сети не передаётся
+    std::string st;        // ключ
+    uint64_t corr = 0;     // идентификатор запроса, ответ несёт тот же
+    std::string value;     // блоб (с WIRE_BLOB), операции пакета Batch или их результаты
+    uint8_t flags = 0;     // WireFlags
+    std::string trace;     // отметки узлов на пути, с WIRE_TRACE
+};
+
+// Принятое сообщение без копирования: кадры ZeroMQ живут, пока жив объект,
+// а поля view указывают прямо в их данные
+class Incoming {
+public:
+    Incoming() {
+        zmq_msg_init(&frame);
+        zmq_msg_init(&extra);
+    }
+    ~Incoming() {
+        zmq_msg_close(&frame);
+        zmq_msg_close(&extra);
+    }
+    Incoming(const Incoming&) = delete;
+    Incoming& operator=(const Incoming&) = delete;
+
+    message toMessage() const;
+
+    zmq_msg_t frame;  // заголовок и поля
+    zmq_msg_t extra;  // значение, если в заголовке стоит WIRE_MORE
+    MessageView view;
+    int from = -1;    // routing id отправителя, если принято из ROUTER
 };
 
 class Node {
@@ -53,22 +98,184 @@ public:
     void* context;
     void* socket;
     std::string address;
-
-    Node* left = nullptr;  // Левый потомок (меньшие id)
-    Node* right = nullptr; // Правый потомок (большие id)
+    bool via_router = false;      // сокет — общий ROUTER родителя, нужен кадр с id
+    bool ready = false;           // ребёнок подключился и подтвердил создание
+    // Сообщения, отправленные до подключения или пока очередь ZeroMQ до узла
+    // полна; не длиннее FlowLimits::outbox, уходят по порядку
+    std::deque<message> outbox;
+    // corr запросов через этого ребёнка без ответа: каждый держит кредит
+    std::unordered_multiset<uint64_t> in_flight;
+    // Create, прошедшие через этого ребёнка: повторяются после его перезапуска,
+    // чтобы восстановить поддерево
+    std::vector<message> subtree_creates;
+    std::chrono::steady_clock::time_point last_seen; // последнее сообщение от ребёнка
 
     int beat_counter = 0;
 };
 
-Node createNode(int id, bool is_child);
-Node createProcess(int id);
-Node* insertChild(Node* root, Node* newChild);
-void send_mes(Node &node, message m);
+// Прямые дети узла: указатели в одном векторе, упорядоченном по id, — поиск
+// двоичный, обход последовательный и без рекурсии. Сами Node не перемещаются:
+// на них ссылается RoutingTable.
+class ChildTable {
+public:
+    ChildTable() = default;
+    ChildTable(const ChildTable&) = delete;
+    ChildTable& operator=(const ChildTable&) = delete;
+    ~ChildTable() {
+        for (Node* node : nodes_)
+            delete node;
+    }
+
+    Node* find(int id) const {
+        auto it = lower(id);
+        return it != nodes_.end() && (*it)->id == id ? *it : nullptr;
+    }
+
+    // Ребёнок с тем же id (упавший до подключения) заменяется на месте
+    Node* add(const Node& node) {
+        auto it = lower(node.id);
+        if (it != nodes_.end() && (*it)->id == node.id) {
+            **it = node;
+            return *it;
+        }
+        return *nodes_.insert(it, new Node(node));
+    }
+
+    size_t size() const { return nodes_.size(); }
+    bool empty() const { return nodes_.empty(); }
+    std::vector<Node*>::const_iterator begin() const { return nodes_.begin(); }
+    std::vector<Node*>::const_iterator end() const { return nodes_.end(); }
+
+private:
+    std::vector<Node*>::const_iterator lower(int id) const {
+        return std::lower_bound(nodes_.begin(), nodes_.end(), id, [](const Node* node, int id) { return node->id < id; });
+    }
+
+    std::vector<Node*> nodes_;
+};
+
+// Таблица маршрутов: id узла поддерева -> прямой ребёнок, через которого он
+// доступен. Заполняется по подтверждениям Create, идущим от нового узла вверх,
+// поэтому запрос проходит один путь длины O(глубины), а не всё поддерево.
+class RoutingTable {
+public:
+    void add(int target, Node* via) { routes[target] = via; }
+    Node* find(int target) const {
+        auto it = routes.find(target);
+        return it == routes.end() ? nullptr : it->second;
+    }
+    size_t size() const { return routes.size(); }
+    // Узлы, доступные через ребёнка via (он сам и его поддерево)
+    std::vector<int> reachableVia(const Node* via) const {
+        std::vector<int> ids;
+        for (const auto& [target, node] : routes) {
+            if (node == via)
+                ids.push_back(target);
+        }
+        return ids;
+    }
+
+private:
+    std::unordered_map<int, Node*> routes;
+};
+
+// Сводка heartbeat поддерева на промежуточном узле: сводки детей копятся и
+// раз в интервал уходят родителю одним сообщением вместе со своим heartbeat,
+// поэтому к управляющему узлу приходит одно сообщение на прямого ребёнка, а не
+// на каждый узел. Возраст — сколько прошло с heartbeat самого узла.
+class BeatAggregator {
+public:
+    void merge(std::string_view summary, int sender, std::chrono::steady_clock::time_point at);
+    // Свой heartbeat и узлы, о которых было слышно за window; остальные забываются
+    std::string summary(int self_id, std::chrono::steady_clock::time_point at, std::chrono::milliseconds window);
+
+private:
+    struct Info {
+        std::chrono::steady_clock::time_point generated; // когда узел отправил heartbeat
+        std::chrono::steady_clock::time_point received;  // когда он был в сводке ребёнка
+    };
+    std::map<int, Info> nodes_; // по id — в порядке разностного кодирования
+};
+
+// Транспорт между процессами-узлами
+enum Transport {
+    TransportTcp,     // tcp://127.0.0.1, порт выбирается динамически
+    TransportIpc,     // Unix-сокет, для узлов на одной машине
+    TransportInproc   // узлы-потоки в одном процессе
+};
+
+void* sharedContext();
+void setTransport(Transport transport);
+bool parseTransport(const std::string& name, Transport& transport);
+Transport transportOf(const std::string& address);
+// Каталог журналов и снимков узлов; пустой — хранилища только в памяти
+void setDataDir(const std::string& dir);
+const std::string& dataDir();
+// Потоки-обработчики словаря на узле; 0 — словарь обслуживает поток цикла событий
+void setNodeWorkers(int workers);
+int nodeWorkers();
+// Запуск процессов-узлов: posix_spawn (по умолчанию) или прежний fork + exec
+enum SpawnMode {
+    SpawnPosix,
+    SpawnFork
+};
+void setSpawnMode(SpawnMode mode);
+// Пределы потока сообщений узла; дети получают их при запуске
+struct FlowLimits {
+    int hwm = 1000;       // ZMQ_SNDHWM и ZMQ_RCVHWM сокетов дерева, сообщений
+    size_t outbox = 4096; // сообщений в outbox ребёнка сверх очереди ZeroMQ
+    size_t window = 1024; // запросов к ребёнку без ответа, дальше — Busy
+};
+const FlowLimits& flowLimits();
+// --hwm N, --outbox N, --window N; false — не параметр потока или значение неверно
+bool parseFlowOption(const std::string& option, const std::string& value);
+bool parseSpawnMode(const std::string& name, SpawnMode& mode);
+bool watchParent(pid_t parent);
+Node createNode(int id, const std::string& parent_address);
+void* childrenSocket(int id, std::string& address);
+Node createProcess(int parent_id, int id);
+// Узлы-потоки: остановка узла id (имитация отказа) и проверка в его цикле
+void stopNodeThread(int id);
+bool nodeStopped();
+int childExitFd();
+// on_down получает упавшего ребёнка и corr запросов, ушедших в него без ответа
+void handleChildExits(const ChildTable& children, std::chrono::milliseconds heartbeat,
+                      const std::function<void(Node&, const std::vector<uint64_t>&)>& on_down);
+void killHungChildren(const ChildTable& children, std::chrono::milliseconds interval);
+// Результат отправки: ушло в сокет, ждёт в outbox (узел не подключён или его
+// очередь ZeroMQ полна), отвергнуто, потому что заполнен outbox или окно, или
+// маршрута к узлу нет
+enum SendResult {
+    SendOk,
+    SendQueued,
+    SendBusy,
+    SendNoRoute
+};
+
+void markReady(Node& node);
+// Дослать outbox по порядку; false — что-то осталось
+bool flushOutbox(Node& node);
+// То же для всех детей; true — у кого-то сообщения ещё ждут
+bool flushOutboxes(const ChildTable& children);
+// Ответ, пришедший от ребёнка, возвращает кредит, если его запрос кредит брал;
+// Unavailable с corr — тоже ответ: запрос потерян в упавшем узле
+void returnCredit(Node& child, uint8_t command, uint64_t corr);
+// Кредит запроса corr, оставшегося без ответа (срок истёк, узел упал)
+void releaseCredit(Node& child, uint64_t corr);
+SendResult send_mes(Node &node, message m);
 message get_mes(Node &node);
-void traverseChildren(Node* root, const std::function<void(Node&)>& f);
-Node* searchChild(Node* root, int id);
+message get_mes_from(void* router, int& from_id);
+bool recv_mes(void* socket, Incoming& in, bool from_router);
+SendResult forward_mes(Node& node, Incoming& in);
+SendResult forward(const RoutingTable& routes, int target, const message& m);
+SendResult forward(const RoutingTable& routes, int target, Incoming& in);
 
 // Функции для heartbeat
-void handle_heartbeat_command(Node* children_root);
-void check_beats();
-void update_beat(int node_id);
+void handle_heartbeat_command(const ChildTable& children, int time);
+long check_beats(const std::function<void(int)>& on_missed);
+bool update_beat(int node_id, uint64_t age_us);
+void handle_beat_summary(std::string_view summary, int sender, const std::function<void(int)>& on_alive);
+void print_beat_stats(std::ostream& out);
+std::chrono::milliseconds heartbeatInterval();
+
+#endif // LIB_H
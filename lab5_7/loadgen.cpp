@@ -0,0 +1,381 @@
+// Генератор нагрузки lab5_7 — эталонный замер дерева узлов для любых изменений
+// производительности. Клиент сам строит дерево заданной глубины и ширины (по
+// уровням, узел 1 — корень) и ведёт смешанную нагрузку ExecAdd / ExecFnd / Ping
+// через клиент на сопрограммах (client.h):
+//   закрытый цикл — clients сессий, каждая шлёт следующий запрос после ответа;
+//   открытый цикл — запросы по пуассоновскому потоку с интенсивностью rate,
+//   задержка считается от назначенного момента, а не от фактической отправки,
+//   поэтому отставание генератора не прячет очередь в узлах.
+// Ключи keyN выбираются равномерно или по Ципфу, узел ключа — по его хэшу, ping —
+// к случайному узлу. Каждые interval секунд — строка с пропускной способностью и
+// перцентилями задержки за интервал, в конце — итог по типам операций.
+// Запуск из каталога сборки (рядом с computing):
+//   ./loadgen [--depth D] [--fanout F] [--mix add:find:ping] [--keys N]
+//             [--dist uniform|zipf] [--theta S] [--closed C | --open R]
+//             [--duration S] [--interval S] [--no-preload] [--timeout MS] [--kill S]
+//             [--transport tcp|ipc|inproc] [--workers N] [--hwm N] [--outbox N] [--window N]
+// --kill S — отказ под нагрузкой: через S секунд замера узел 2 (второй уровень)
+// получает SIGKILL; родитель перезапускает его, а по строкам интервалов видно,
+// как быстро восстанавливается пропускная способность.
+#include "client.h"
+#include "cluster.h"
+#include "zipf.h"
+#include "hdr_histogram.h"
+#include <charconv>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <csignal>
+
+int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+template <typename T>
+bool parseNumber(std::string_view word, T& value) {
+    auto result = std::from_chars(word.data(), word.data() + word.size(), value);
+    return result.ec == std::errc() && result.ptr == word.data() + word.size();
+}
+
+enum OpKind { OpAdd, OpFind, OpPing, OP_KINDS };
+const char* op_names[OP_KINDS] = {"add", "find", "ping"};
+
+struct Options {
+    int depth = 3, fanout = 4;
+    int mix[OP_KINDS] = {20, 70, 10}; // доли операций
+    size_t keys = 100000;
+    bool zipf = false;
+    double theta = 0.99;
+    bool open_loop = false;
+    int clients = 64;
+    double rate = 10000;              // запросов в секунду для открытого цикла
+    double duration = 10, interval = 1;
+    bool preload = true;
+    int timeout_ms = 5000;
+    size_t max_outstanding = 100000;  // открытый цикл: сверх этого запросы не отправляются
+    double kill_at = 0;               // секунда замера, когда убить узел KILLED_NODE; 0 — нет
+    Transport transport = TransportTcp;
+};
+
+const int KILLED_NODE = 2;
+
+// Итоги запросов: задержка по типам операций, нс, и исходы
+struct LoadStats {
+    LatencyHistogram latency[OP_KINDS];
+    LatencyHistogram all;
+    uint64_t status[5] = {}; // по Reply::Status
+    uint64_t dropped = 0;    // открытый цикл: не отправлено, в полёте уже max_outstanding
+
+    void record(int kind, Reply::Status result, int64_t ns) {
+        ++status[result];
+        // Задержка — только у завершённых: срок ответа исказил бы перцентили
+        if (result == Reply::Ok || result == Reply::NotFound) {
+            latency[kind].record(ns);
+            all.record(ns);
+        }
+    }
+    void merge(const LoadStats& other) {
+        for (int kind = 0; kind < OP_KINDS; ++kind)
+            latency[kind].merge(other.latency[kind]);
+        all.merge(other.all);
+        for (int i = 0; i < 5; ++i)
+            status[i] += other.status[i];
+        dropped += other.dropped;
+    }
+    void reset() {
+        for (LatencyHistogram& hist : latency)
+            hist.reset();
+        all.reset();
+        std::fill(std::begin(status), std::end(status), 0);
+        dropped = 0;
+    }
+    uint64_t completed() const { return status[Reply::Ok] + status[Reply::NotFound]; }
+    uint64_t failed() const { return status[Reply::Timeout] + status[Reply::Unavailable] + status[Reply::Busy]; }
+};
+
+struct Op {
+    OpKind kind;
+    int node;
+    std::string key;
+    int64_t value;
+};
+
+// Поток операций: тип по долям mix, ключ равномерно или по Ципфу
+class Workload {
+public:
+    Workload(const Options& options, int nodes)
+        : options_(options), nodes_(nodes), rng_(42), pick_node_(1, nodes), pick_key_(0, options.keys - 1) {
+        if (options.zipf)
+            zipf_ = std::make_unique<ZipfGenerator>(options.keys, options.theta);
+        mix_total_ = options.mix[OpAdd] + options.mix[OpFind] + options.mix[OpPing];
+    }
+
+    int nodeOf(const std::string& key) const { return (int)(HashRing::hash(key) % nodes_) + 1; }
+
+    Op next() {
+        Op op;
+        int roll = std::uniform_int_distribution<int>(0, mix_total_ - 1)(rng_);
+        op.kind = roll < options_.mix[OpAdd] ? OpAdd : roll < options_.mix[OpAdd] + options_.mix[OpFind] ? OpFind : OpPing;
+        if (op.kind == OpPing) {
+            op.node = pick_node_(rng_);
+            return op;
+        }
+        size_t index = zipf_ ? (*zipf_)(rng_) : pick_key_(rng_);
+        op.key = "key" + std::to_string(index);
+        op.node = nodeOf(op.key);
+        op.value = (int64_t)index;
+        return op;
+    }
+
+    // Интервал до следующего запроса открытого цикла, нс
+    int64_t nextGap() { return (int64_t)(std::exponential_distribution<double>(options_.rate)(rng_) * 1e9); }
+
+private:
+    const Options& options_;
+    int nodes_;
+    std::mt19937_64 rng_;
+    std::uniform_int_distribution<int> pick_node_;
+    std::uniform_int_distribution<size_t> pick_key_;
+    std::unique_ptr<ZipfGenerator> zipf_;
+    int mix_total_;
+};
+
+// Один запрос; задержка — от scheduled (открытый цикл) или от отправки
+Task<> issue(Cluster& cluster, Op op, int64_t scheduled, LoadStats& stats) {
+    Reply reply;
+    switch (op.kind) {
+    case OpAdd:
+        reply = co_await cluster.exec_add(op.node, op.key, op.value);
+        break;
+    case OpFind:
+        reply = co_await cluster.exec_find(op.node, op.key);
+        break;
+    default:
+        reply = co_await cluster.ping(op.node);
+        break;
+    }
+    stats.record(op.kind, reply.status, now_ns() - scheduled);
+}
+
+// Сессия закрытого цикла
+Task<> session(Cluster& cluster, Workload& workload, const bool& running, LoadStats& stats) {
+    while (running)
+        co_await issue(cluster, workload.next(), now_ns(), stats);
+}
+
+// Узел k > 1 в дереве по уровням — ребёнок (k - 2) / fanout + 1
+Task<> createNode(Cluster& cluster, int id, int fanout, std::vector<pid_t>& pids, int& failed) {
+    Reply created = co_await cluster.create(id, id == 1 ? -1 : (id - 2) / fanout + 1);
+    if (!created.ok()) {
+        std::cerr << "Node " << id << ": " << replyStatusName(created.status) << std::endl;
+        ++failed;
+    }
+    pids[id] = (pid_t)created.num;
+}
+
+// Предзаполнение: все ключи записываются, чтобы поиск находил их
+Task<> preloadSession(Cluster& cluster, const Workload& workload, size_t& next_key, size_t keys, int& failed) {
+    while (next_key < keys) {
+        size_t index = next_key++;
+        std::string key = "key" + std::to_string(index);
+        Reply added = co_await cluster.exec_add(workload.nodeOf(key), key, (int64_t)index);
+        failed += !added.ok();
+    }
+}
+
+void printInterval(double at, double seconds, const LoadStats& stats) {
+    std::printf("%7.1f s: %9.0f ops/s, failed %llu, busy %llu, timeouts %llu, dropped %llu,"
+                " ms p50 %.3f p99 %.3f p99.9 %.3f max %.3f\n",
+                at, stats.completed() / seconds, (unsigned long long)stats.failed(),
+                (unsigned long long)stats.status[Reply::Busy], (unsigned long long)stats.status[Reply::Timeout],
+                (unsigned long long)stats.dropped, stats.all.percentile(50) / 1e6, stats.all.percentile(99) / 1e6,
+                stats.all.percentile(99.9) / 1e6, stats.all.max() / 1e6);
+    std::fflush(stdout);
+}
+
+void printSummary(double seconds, const LoadStats& stats) {
+    std::printf("Total: %llu ops in %.2f s (%.0f ops/s), not found %llu, busy %llu, timeouts %llu, unavailable %llu,"
+                " dropped %llu\n",
+                (unsigned long long)stats.completed(), seconds, stats.completed() / seconds,
+                (unsigned long long)stats.status[Reply::NotFound], (unsigned long long)stats.status[Reply::Busy],
+                (unsigned long long)stats.status[Reply::Timeout], (unsigned long long)stats.status[Reply::Unavailable],
+                (unsigned long long)stats.dropped);
+    for (int kind = 0; kind < OP_KINDS; ++kind) {
+        const LatencyHistogram& hist = stats.latency[kind];
+        if (hist.count() == 0)
+            continue;
+        std::printf("  %-4s %10llu ops, ms p50 %.3f p99 %.3f p99.9 %.3f max %.3f\n", op_names[kind],
+                    (unsigned long long)hist.count(), hist.percentile(50) / 1e6, hist.percentile(99) / 1e6,
+                    hist.percentile(99.9) / 1e6, hist.max() / 1e6);
+    }
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = i + 1 < argc ? argv[i + 1] : "";
+        bool ok = i + 1 < argc;
+        int workers;
+        if (arg == "--no-preload") {
+            options.preload = false;
+            continue;
+        } else if (arg == "--depth")
+            ok = ok && parseNumber(value, options.depth) && options.depth >= 1;
+        else if (arg == "--fanout")
+            ok = ok && parseNumber(value, options.fanout) && options.fanout >= 1;
+        else if (arg == "--mix") {
+            int* mix = options.mix;
+            ok = ok && std::sscanf(value.c_str(), "%d:%d:%d", &mix[OpAdd], &mix[OpFind], &mix[OpPing]) == 3
+                 && mix[OpAdd] >= 0 && mix[OpFind] >= 0 && mix[OpPing] >= 0 && mix[OpAdd] + mix[OpFind] + mix[OpPing] > 0;
+        } else if (arg == "--keys")
+            ok = ok && parseNumber(value, options.keys) && options.keys > 0;
+        else if (arg == "--dist")
+            ok = ok && (value == "uniform" || value == "zipf") && ((options.zipf = value == "zipf"), true);
+        else if (arg == "--theta")
+            ok = ok && parseNumber(value, options.theta) && options.theta > 0;
+        else if (arg == "--closed") {
+            ok = ok && parseNumber(value, options.clients) && options.clients > 0;
+            options.open_loop = false;
+        } else if (arg == "--open") {
+            ok = ok && parseNumber(value, options.rate) && options.rate > 0;
+            options.open_loop = true;
+        } else if (arg == "--duration")
+            ok = ok && parseNumber(value, options.duration) && options.duration > 0;
+        else if (arg == "--interval")
+            ok = ok && parseNumber(value, options.interval) && options.interval > 0;
+        else if (arg == "--timeout")
+            ok = ok && parseNumber(value, options.timeout_ms) && options.timeout_ms > 0;
+        else if (arg == "--kill")
+            ok = ok && parseNumber(value, options.kill_at) && options.kill_at > 0;
+        else if (arg == "--transport")
+            ok = ok && parseTransport(value, options.transport) && (setTransport(options.transport), true);
+        else if (arg == "--workers")
+            ok = ok && parseNumber(value, workers) && workers >= 0 && workers <= 64
+                          && (setNodeWorkers(workers), true);
+        else
+            ok = ok && parseFlowOption(arg, value);
+        if (!ok)
+            return false;
+        ++i;
+    }
+    return true;
+}
+
+int run(const Options& options) {
+    int nodes = 0;
+    for (int level = 0, width = 1; level < options.depth; ++level, width *= options.fanout)
+        nodes += width;
+    Cluster cluster(std::chrono::milliseconds(options.timeout_ms));
+
+    // Дерево строится по уровням: узлы уровня создаются одновременно
+    int64_t start = now_ns();
+    int failed = 0;
+    std::vector<pid_t> pids(nodes + 1);
+    for (int first = 1, width = 1; first <= nodes && failed == 0; first += width, width *= options.fanout) {
+        for (int id = first; id < first + width && id <= nodes; ++id)
+            cluster.spawn(createNode(cluster, id, options.fanout, pids, failed));
+        cluster.run();
+    }
+    if (failed)
+        return 1;
+    std::printf("Tree: %d nodes, depth %d, fanout %d, built in %.2f s\n", nodes, options.depth, options.fanout,
+                (now_ns() - start) / 1e9);
+
+    Workload workload(options, nodes);
+    if (options.preload) {
+        start = now_ns();
+        size_t next_key = 0;
+        // Не больше окна кредитов: иначе часть записей отвергнет сам корень
+        size_t sessions = std::min<size_t>(256, flowLimits().window);
+        for (size_t i = 0; i < sessions; ++i)
+            cluster.spawn(preloadSession(cluster, workload, next_key, options.keys, failed));
+        cluster.run();
+        std::printf("Preload: %zu keys in %.2f s, failed %d\n", options.keys, (now_ns() - start) / 1e9, failed);
+    }
+    std::printf("Workload: add:find:ping %d:%d:%d, %zu keys ", options.mix[OpAdd], options.mix[OpFind],
+                options.mix[OpPing], options.keys);
+    options.zipf ? std::printf("zipf %g, ", options.theta) : std::printf("uniform, ");
+    options.open_loop ? std::printf("open loop %.0f/s\n", options.rate)
+                      : std::printf("closed loop, %d clients\n", options.clients);
+    std::fflush(stdout);
+
+    // Основной цикл: события клиента, назначенные запросы и отчёт раз в interval
+    LoadStats window, total;
+    bool running = true;
+    start = now_ns();
+    int64_t interval_ns = (int64_t)(options.interval * 1e9);
+    int64_t end = start + (int64_t)(options.duration * 1e9);
+    int64_t next_report = start + interval_ns, last_report = start;
+    int64_t next_arrival = start;
+    int64_t kill_time = options.kill_at > 0 ? start + (int64_t)(options.kill_at * 1e9) : INT64_MAX;
+    if (!options.open_loop) {
+        for (int i = 0; i < options.clients; ++i)
+            cluster.spawn(session(cluster, workload, running, window));
+    }
+    while (true) {
+        int64_t current = now_ns();
+        if (options.open_loop) {
+            for (; next_arrival <= current && next_arrival < end; next_arrival += workload.nextGap()) {
+                if (cluster.in_flight() >= options.max_outstanding)
+                    ++window.dropped;
+                else
+                    cluster.spawn(issue(cluster, workload.next(), next_arrival, window));
+            }
+        }
+        if (current >= kill_time) {
+            kill(pids[KILLED_NODE], SIGKILL);
+            std::printf("%7.1f s: node %d (pid %d) killed\n", (current - start) / 1e9, KILLED_NODE,
+                        (int)pids[KILLED_NODE]);
+            kill_time = INT64_MAX;
+        }
+        if (current >= next_report || current >= end) {
+            double seconds = (current - last_report) / 1e9;
+            printInterval((current - start) / 1e9, seconds, window);
+            total.merge(window);
+            window.reset();
+            last_report = current;
+            next_report += interval_ns;
+            if (current >= end)
+                break;
+        }
+        int64_t wake = std::min({next_report, end, kill_time});
+        if (options.open_loop)
+            wake = std::min(wake, next_arrival);
+        cluster.poll(std::max<int64_t>(0, (wake - current + 999999) / 1000000));
+    }
+    // Сессии завершают текущий запрос, открытые запросы дожидаются ответа или срока;
+    // в итог они не входят
+    running = false;
+    cluster.run();
+    printSummary((last_report - start) / 1e9, total);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--depth D] [--fanout F] [--mix add:find:ping] [--keys N]"
+                  << " [--dist uniform|zipf] [--theta S] [--closed C | --open R] [--duration S] [--interval S]"
+                  << " [--no-preload] [--timeout MS] [--kill S] [--transport tcp|ipc|inproc] [--workers N]"
+                  << " [--hwm N] [--outbox N] [--window N]" << std::endl;
+        return 1;
+    }
+    // Все запросы идут через корень, а у него не больше window запросов в полёте:
+    // лишние сессии получали бы только Busy и мерили отказы, а не дерево
+    if (!options.open_loop && (size_t)options.clients > flowLimits().window) {
+        std::cerr << "--closed " << options.clients << " exceeds --window " << flowLimits().window
+                  << ": raise --window or use fewer clients" << std::endl;
+        return 1;
+    }
+    // Убивается процесс: узлам-потокам (inproc) перезапускать некого
+    if (options.kill_at > 0 && (options.depth < 2 || options.transport == TransportInproc)) {
+        std::cerr << "--kill needs --depth 2 or more and a process transport" << std::endl;
+        return 1;
+    }
+    int code = run(options);
+    // Узлы-потоки (inproc) не завершаются: выход без деструкторов статических объектов
+    std::fflush(stdout);
+    _exit(code);
+}
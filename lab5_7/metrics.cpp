@@ -0,0 +1,96 @@
+#include "metrics.h"
+#include "wire.h"
+#include <chrono>
+#include <cstdio>
+
+NodeMetrics& nodeMetrics()
+{
+    // Узел — это поток цикла событий: в процессе-узле он один, а узлы-потоки
+    // одного процесса не смешивают свои счётчики
+    thread_local NodeMetrics metrics;
+    return metrics;
+}
+
+const char* commandName(uint8_t command)
+{
+    static const char* names[NodeMetrics::COMMANDS] = {
+        "None", "Create", "Ping", "ExecAdd", "ExecFnd", "ExecErr", "HeartBeat", "Batch",
+        "ExecDel", "ExecScan", "ExecRange", "Unavailable", "ExecMerge", "Stats", "Busy", "?"};
+    return names[command % NodeMetrics::COMMANDS];
+}
+
+static void appendCounts(std::string& out, const char* title, const uint64_t (&counts)[NodeMetrics::COMMANDS])
+{
+    out += title;
+    bool first = true;
+    for (int i = 0; i < NodeMetrics::COMMANDS; ++i)
+    {
+        if (counts[i] == 0)
+            continue;
+        out += first ? " " : ", ";
+        out += commandName(i);
+        out += ' ';
+        out += std::to_string(counts[i]);
+        first = false;
+    }
+    out += '\n';
+}
+
+static void appendLatency(std::string& out, const char* title, const LatencyHistogram& hist)
+{
+    char line[160];
+    snprintf(line, sizeof(line), "%s count %llu, p50 %.1f, p99 %.1f, max %.1f\n", title,
+             (unsigned long long)hist.count(), hist.percentile(50) / 1000.0, hist.percentile(99) / 1000.0,
+             hist.max() / 1000.0);
+    out += line;
+}
+
+std::string formatMetrics(const NodeMetrics& metrics)
+{
+    std::string out;
+    appendCounts(out, "in:", metrics.in);
+    appendCounts(out, "out:", metrics.out);
+    out += "flow: queued " + std::to_string(metrics.queued) + ", busy " + std::to_string(metrics.busy) + '\n';
+    appendLatency(out, "forward us:", metrics.forward_ns);
+    appendLatency(out, "dictionary us:", metrics.op_ns);
+    return out;
+}
+
+uint64_t traceNow()
+{
+    auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(since_epoch).count();
+}
+
+void traceHop(std::string& trace, int id)
+{
+    trace_append(trace, id, traceNow());
+}
+
+// Trace: -1 -> 1 +12 us -> 2 +30 us -> ... (total N us): каждый участок — время
+// от отметки предыдущего узла до отметки следующего (передача и очередь)
+std::string formatTrace(std::string_view trace, uint64_t arrived)
+{
+    std::string out = "Trace:";
+    const char* pos = trace.data();
+    const char* end = pos + trace.size();
+    int64_t id;
+    uint64_t time_us, first = 0, previous = 0;
+    bool started = false;
+    while (trace_next(pos, end, id, time_us))
+    {
+        out += started ? " -> " : " ";
+        out += std::to_string(id);
+        if (started)
+            out += " +" + std::to_string(time_us - previous) + " us";
+        else
+            first = time_us;
+        previous = time_us;
+        started = true;
+    }
+    if (!started)
+        return out + " empty";
+    out += " -> back +" + std::to_string(arrived - previous) + " us (total " + std::to_string(arrived - first)
+           + " us)";
+    return out;
+}
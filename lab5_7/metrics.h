@@ -0,0 +1,37 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "hdr_histogram.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Счётчики узла для команды stats. Их ведёт поток цикла событий (у каждого
+// узла-потока свои), поэтому обновление — обычный инкремент без атомиков:
+// приём и отправка сообщения стоят одного сложения, а задержки — двух чтений
+// steady_clock на сообщение.
+struct NodeMetrics {
+    static const int COMMANDS = 16;
+    uint64_t in[COMMANDS] = {};  // принято сообщений по командам
+    uint64_t out[COMMANDS] = {}; // отправлено (вместе с пересланными)
+    uint64_t queued = 0;         // отложено в outbox: очередь ZeroMQ до узла была полна
+    uint64_t busy = 0;           // отвергнуто: полон outbox или исчерпано окно
+    LatencyHistogram forward_ns; // от приёма сообщения до пересылки дальше, нс
+    LatencyHistogram op_ns;      // запрос к своему словарю от приёма до ответа, нс
+};
+
+// Счётчики узла текущего потока
+NodeMetrics& nodeMetrics();
+
+const char* commandName(uint8_t command);
+// Строки «имя: значения» для ответа stats
+std::string formatMetrics(const NodeMetrics& metrics);
+
+// Время для трассы: steady_clock в микросекундах, общий для процессов одной машины
+uint64_t traceNow();
+// Отметка узла id в трассе
+void traceHop(std::string& trace, int id);
+// Разбивка трассы по участкам; arrived — время прихода ответа
+std::string formatTrace(std::string_view trace, uint64_t arrived);
+
+#endif // METRICS_H
@@ -0,0 +1,438 @@
+#include "node.h"
+#include "worker_pool.h"
+#include "metrics.h"
+#include <iostream>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <vector>
+#include <algorithm>
+
+using namespace std::chrono;
+
+// Запрос к своему словарю, разосланный частям: ответ собирается, когда
+// вернутся все задания
+struct LocalRequest {
+    message reply;
+    std::vector<Job*> parts;     // по части словаря; nullptr — у части нет операций
+    std::vector<uint32_t> order; // часть словаря каждой операции пакета по порядку
+    size_t waiting = 0;
+    steady_clock::time_point received;
+};
+
+// Ответ из результатов частей. Пакет собирается в исходном порядке операций,
+// скан — слиянием найденного всеми частями
+static void buildReply(LocalRequest& request)
+{
+    message& reply = request.reply;
+    if (reply.command == Batch)
+    {
+        std::vector<const char*> pos(request.parts.size()), end(request.parts.size());
+        for (size_t i = 0; i < request.parts.size(); ++i)
+        {
+            if (request.parts[i])
+            {
+                pos[i] = request.parts[i]->results.data();
+                end[i] = pos[i] + request.parts[i]->results.size();
+            }
+        }
+        uint8_t command;
+        int64_t num;
+        std::string_view key, blob;
+        for (uint32_t shard : request.order)
+        {
+            if (batch_next(pos[shard], end[shard], command, num, key, blob))
+                batch_append(reply.value, command, num, {}, blob);
+        }
+    }
+    else if (reply.command == ExecScan)
+    {
+        std::vector<std::pair<std::string_view, std::string_view>> entries; // ключ и запись целиком
+        for (Job* part : request.parts)
+        {
+            const char* pos = part->results.data();
+            const char* end = pos + part->results.size();
+            const char* record = pos;
+            uint8_t command;
+            int64_t num;
+            std::string_view key, blob;
+            while (batch_next(pos, end, command, num, key, blob))
+            {
+                entries.push_back({key, std::string_view(record, pos - record)});
+                record = pos;
+            }
+        }
+        std::sort(entries.begin(), entries.end());
+        size_t limit = request.parts.empty() ? 0 : request.parts[0]->limit;
+        if (limit && entries.size() > limit)
+            entries.resize(limit);
+        reply.num = (int64_t)entries.size();
+        for (const auto& entry : entries)
+            reply.value.append(entry.second);
+    }
+    else
+    {
+        // Одиночная операция: ключ в ответе не повторяется, управляющий узел
+        // берёт его из запроса
+        Job* part = request.parts[request.order[0]];
+        const char* pos = part->results.data();
+        uint8_t command;
+        int64_t num;
+        std::string_view key, blob;
+        if (batch_next(pos, pos + part->results.size(), command, num, key, blob))
+        {
+            reply.command = (com)(command & ~BATCH_BLOB);
+            reply.num = num;
+            if (command & BATCH_BLOB)
+            {
+                reply.flags |= WIRE_BLOB;
+                reply.value = std::string(blob);
+            }
+        }
+    }
+}
+
+// Узел дерева: процесс computing или поток при транспорте inproc. Всё его
+// состояние — в этой функции и в thread_local (счётчики, ROUTER детей)
+int runNode(int id, const std::string& parent_address)
+{
+    Node I = createNode(id, parent_address);
+    // Поток цикла только маршрутизирует; словарём занимаются обработчики
+    WorkerPool pool;
+    if (!pool.start(I.id, nodeWorkers(), dataDir()))
+        return 1;
+    NodeMetrics& metrics = nodeMetrics();
+    send_mes(I, {Create, I.id, I.pid});
+    void* router = nullptr; // общий сокет детей, появляется с первым ребёнком
+    ChildTable children;
+    RoutingTable routes;
+    std::unordered_map<uint64_t, LocalRequest> local;
+    uint64_t next_request = 0;
+
+    // Запрос к своему словарю раскладывается на задания частям
+    auto submitLocal = [&](const MessageView& m) {
+        uint64_t number = next_request++;
+        LocalRequest& request = local[number];
+        request.reply = message((com)m.command, I.id, m.num);
+        request.reply.corr = m.corr;
+        request.received = steady_clock::now();
+        if (m.flags & WIRE_TRACE)
+        {
+            request.reply.flags = WIRE_TRACE;
+            request.reply.trace = std::string(m.trace);
+            traceHop(request.reply.trace, I.id);
+        }
+        request.parts.assign(pool.shards(), nullptr);
+        auto part = [&](size_t shard, Job::Kind kind) {
+            Job*& job = request.parts[shard];
+            if (!job)
+            {
+                job = new Job;
+                job->kind = kind;
+                job->request = number;
+                job->shard = shard;
+                ++request.waiting;
+            }
+            return job;
+        };
+        if (m.command == ExecScan || m.command == ExecRange)
+        {
+            request.reply.command = ExecScan;
+            for (size_t shard = 0; shard < pool.shards(); ++shard)
+            {
+                Job* job = part(shard, m.command == ExecScan ? Job::Scan : Job::Range);
+                job->key = m.key;
+                job->to = m.value;
+                job->limit = m.num;
+            }
+        }
+        else if (m.command == Batch)
+        {
+            const char* pos = m.value.data();
+            const char* end = pos + m.value.size();
+            uint8_t command;
+            int64_t num;
+            std::string_view key, blob;
+            while (batch_next(pos, end, command, num, key, blob))
+            {
+                size_t shard = pool.shard_of(key);
+                batch_append(part(shard, Job::Ops)->ops, command, num, key, blob);
+                request.order.push_back(shard);
+            }
+        }
+        else
+        {
+            size_t shard = pool.shard_of(m.key);
+            batch_append(part(shard, Job::Ops)->ops, m.command | (m.flags & WIRE_BLOB ? BATCH_BLOB : 0), m.num,
+                         m.key, m.value);
+            request.order.push_back(shard);
+        }
+        if (request.waiting == 0)
+        {
+            // Пустой пакет
+            send_mes(I, request.reply);
+            local.erase(number);
+            return;
+        }
+        for (Job* job : request.parts)
+        {
+            if (job)
+                pool.submit(job);
+        }
+    };
+
+    // Готовые задания; ответ уходит, когда собраны все части запроса.
+    // false — журнал не записан: узел завершается, не подтвердив изменений
+    auto completeJobs = [&]() {
+        while (Job* job = pool.take())
+        {
+            if (job->failed)
+            {
+                std::cerr << "Node " << I.id << ": log write failed" << std::endl;
+                return false;
+            }
+            auto it = local.find(job->request);
+            if (--it->second.waiting > 0)
+                continue;
+            buildReply(it->second);
+            if (it->second.reply.flags & WIRE_TRACE)
+                traceHop(it->second.reply.trace, I.id);
+            send_mes(I, it->second.reply);
+            metrics.op_ns.record(duration_cast<nanoseconds>(steady_clock::now() - it->second.received).count());
+            for (Job* part : it->second.parts)
+                delete part;
+            local.erase(it);
+        }
+        return true;
+    };
+
+    // Переменные для heartbeat
+    std::chrono::milliseconds local_heartbeat(0);
+    auto last_beat = steady_clock::now();
+    BeatAggregator beats;
+
+    // Цикл событий: ждём в zmq_poll сообщения от родителя или детей либо
+    // наступления срока очередного heartbeat. Отложенное в outbox досылается
+    // в начале каждой итерации: родителю — когда DEALER снова готов к записи,
+    // детям — с повтором через 1 мс (готовность ROUTER к ребёнку не опрашивается)
+    while (!nodeStopped())
+    {
+        long timeout = -1;
+        if (local_heartbeat > milliseconds::zero())
+        {
+            auto elapsed = duration_cast<milliseconds>(steady_clock::now() - last_beat);
+            timeout = std::max<long>(0, (local_heartbeat - elapsed).count());
+        }
+        bool parent_waiting = !flushOutbox(I);
+        if (flushOutboxes(children) && (timeout < 0 || timeout > 1))
+            timeout = 1;
+        zmq_pollitem_t items[4] = {{I.socket, 0, (short)(ZMQ_POLLIN | (parent_waiting ? ZMQ_POLLOUT : 0)), 0},
+                                   {nullptr, childExitFd(), ZMQ_POLLIN, 0}};
+        int item_count = 2, router_item = -1;
+        if (pool.done_socket())
+            items[item_count++] = {pool.done_socket(), 0, ZMQ_POLLIN, 0};
+        if (router)
+        {
+            router_item = item_count;
+            items[item_count++] = {router, 0, ZMQ_POLLIN, 0};
+        }
+        zmq_poll(items, item_count, timeout);
+        if (!completeJobs())
+            return 1;
+
+        // Периодическая отправка родителю heartbeat со сводкой поддерева
+        if (local_heartbeat > std::chrono::milliseconds::zero() &&
+            steady_clock::now() - last_beat >= local_heartbeat)
+        {
+            message hb(HeartBeat, I.id, -1);
+            hb.value = beats.summary(I.id, steady_clock::now(), 2 * local_heartbeat);
+            send_mes(I, hb);
+            last_beat = steady_clock::now();
+            killHungChildren(children, local_heartbeat);
+        }
+
+        // Упавший ребёнок перезапускается; пока он не подключится, управляющий
+        // узел отвечает на запросы к его поддереву ошибкой, не дожидаясь срока.
+        // Потерянные в нём запросы завершаются Unavailable со своим corr: по нему
+        // предки возвращают кредиты, а отправитель получает отказ сразу
+        if (items[1].revents & ZMQ_POLLIN)
+        {
+            handleChildExits(children, local_heartbeat, [&](Node& child, const std::vector<uint64_t>& lost) {
+                for (int id : routes.reachableVia(&child))
+                    send_mes(I, message(Unavailable, id, 0));
+                for (uint64_t corr : lost)
+                {
+                    message failed(Unavailable, child.id, I.id);
+                    failed.corr = corr;
+                    send_mes(I, failed);
+                }
+            });
+        }
+
+        // Пересылаем родителю все ответы от дочерних узлов
+        if (router_item >= 0 && (items[router_item].revents & ZMQ_POLLIN))
+        {
+            Incoming in;
+            auto received = steady_clock::now();
+            while (recv_mes(router, in, true))
+            {
+                Node* child = children.find(in.from);
+                if (!child)
+                    continue;
+                child->last_seen = received;
+                returnCredit(*child, in.view.command, in.view.corr);
+                // Подтверждение создания: новый узел доступен через этого ребёнка;
+                // если это сам ребёнок, он подключился и может получать сообщения
+                if (in.view.command == Create)
+                {
+                    if (in.view.id == in.from)
+                        markReady(*child);
+                    routes.add(in.view.id, child);
+                }
+                // Heartbeat детей не пересылаются, а копятся до своего
+                if (in.view.command == HeartBeat)
+                {
+                    beats.merge(in.view.value, (int)in.view.id, received);
+                    continue;
+                }
+                forward_mes(I, in);
+                metrics.forward_ns.record(duration_cast<nanoseconds>(steady_clock::now() - received).count());
+            }
+        }
+
+        if (!(items[0].revents & ZMQ_POLLIN))
+            continue;
+        // Обрабатываем все сообщения от родителя
+        Incoming in;
+        auto received = steady_clock::now();
+        auto forwardDown = [&](Incoming& incoming) {
+            SendResult result = forward(routes, (int)incoming.view.id, incoming);
+            if (result == SendBusy || result == SendNoRoute)
+            {
+                // Путь к узлу перегружен или его нет: отказ уходит сразу, а не
+                // после срока ответа
+                message refused(result == SendBusy ? Busy : Unavailable, (int)incoming.view.id, I.id);
+                refused.corr = incoming.view.corr;
+                if (incoming.view.flags & WIRE_TRACE)
+                {
+                    refused.flags = WIRE_TRACE;
+                    refused.trace = std::string(incoming.view.trace);
+                    traceHop(refused.trace, I.id);
+                }
+                send_mes(I, refused);
+            }
+            metrics.forward_ns.record(duration_cast<nanoseconds>(steady_clock::now() - received).count());
+        };
+        while (recv_mes(I.socket, in, false))
+        {
+            const MessageView& m = in.view;
+            switch (m.command)
+            {
+            case Create:
+                if (m.id == I.id)
+                {
+                    Node* child = children.add(createProcess(I.id, (int)m.num));
+                    router = child->socket;
+                    routes.add(child->id, child);
+                }
+                else
+                {
+                    // Запоминаем у ребёнка, через которого идёт создание, — для перезапуска
+                    if (Node* via = routes.find((int)m.id))
+                        via->subtree_creates.push_back(in.toMessage());
+                    forwardDown(in);
+                }
+                break;
+            case Ping:
+                if (m.id == I.id)
+                    forward_mes(I, in);
+                else
+                    forwardDown(in);
+                break;
+            case ExecAdd:
+            case ExecFnd:
+            case ExecDel:
+            case ExecMerge:
+                if (m.id == I.id)
+                    submitLocal(m);
+                else
+                    forwardDown(in);
+                break;
+            case ExecScan:
+            case ExecRange:
+                if (m.id == I.id)
+                    submitLocal(m);
+                else
+                    forwardDown(in);
+                break;
+            case Batch:
+                if (m.id == I.id)
+                {
+                    // Операции пакета расходятся по частям словаря, результаты
+                    // уходят одним ответом в исходном порядке
+                    submitLocal(m);
+                }
+                else
+                    forwardDown(in);
+                break;
+            case Stats:
+                if (m.id == I.id)
+                {
+                    size_t outbox = I.outbox.size(), in_flight = 0;
+                    for (Node* child : children)
+                    {
+                        outbox += child->outbox.size();
+                        in_flight += child->in_flight.size();
+                    }
+                    message reply(Stats, I.id, 0);
+                    reply.corr = m.corr;
+                    reply.value = formatMetrics(metrics);
+                    reply.value += "queues: outbox " + std::to_string(outbox) + ", in flight "
+                                   + std::to_string(in_flight) + ", requests "
+                                   + std::to_string(local.size()) + ", jobs " + std::to_string(pool.in_flight()) + '\n';
+                    reply.value += "dictionary: " + std::to_string(pool.keys()) + " keys in "
+                                   + std::to_string(pool.shards()) + " shards\n";
+                    reply.value += "tree: children " + std::to_string(children.size()) + ", routes "
+                                   + std::to_string(routes.size()) + '\n';
+                    if (m.flags & WIRE_TRACE)
+                    {
+                        reply.flags = WIRE_TRACE;
+                        reply.trace = std::string(m.trace);
+                        traceHop(reply.trace, I.id);
+                    }
+                    send_mes(I, reply);
+                }
+                else
+                    forwardDown(in);
+                break;
+            case HeartBeat:
+                // Обновляем локальный интервал heartbeat при получении команды от управляющего узла
+                // и передаём его дальше по поддереву
+                local_heartbeat = std::chrono::milliseconds(m.num);
+                last_beat = steady_clock::now();
+                for (Node* child : children)
+                {
+                    child->last_seen = steady_clock::now();
+                    forward_mes(*child, in);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        // Без обработчиков — групповая фиксация журнала за итерацию, затем ответы
+        pool.flush();
+        if (!completeJobs())
+            return 1;
+    }
+    // Остановленный узел-поток уходит со всем поддеревом, как процессы по
+    // PDEATHSIG; родитель замечает это только по пропавшим heartbeat
+    for (Node* child : children)
+        stopNodeThread(child->id);
+    if (router)
+        zmq_close(router);
+    zmq_close(I.socket);
+    return 0;
+}
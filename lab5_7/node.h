@@ -0,0 +1,11 @@
+#ifndef NODE_H
+#define NODE_H
+
+#include "lib.h"
+
+// Цикл вычислительного узла id, подключённого к ROUTER родителя по адресу
+// parent_address; возвращает код завершения. Процесс computing выполняет его
+// в main, а при транспорте inproc каждый узел — свой поток в одном процессе.
+int runNode(int id, const std::string& parent_address);
+
+#endif // NODE_H
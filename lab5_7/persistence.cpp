@@ -0,0 +1,369 @@
+#include "persistence.h"
+#include "lib.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <iostream>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'L', '5', '7', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t SNAPSHOT_VERSION = 1;
+// Снимок не делается, пока журнал меньше этого порога и меньше самого снимка
+const uint64_t SNAPSHOT_MIN_WAL = 4 << 20;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t wal_seq;      // первый сегмент журнала, не вошедший в снимок
+    uint64_t count;        // число записей
+    uint64_t payload_size; // байт записей после заголовка
+    uint32_t checksum;     // FNV-1a записей
+    uint32_t reserved2;
+};
+
+uint32_t fnv1a(const char* data, size_t size, uint32_t hash = 2166136261u)
+{
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    return hash;
+}
+
+bool write_all(int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void sync_dir(const std::string& dir)
+{
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd != -1)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// Применение записи журнала или снимка к хранилищу
+bool apply_record(KvStore& store, uint8_t command, int64_t num, std::string_view key, std::string_view blob)
+{
+    switch (command & ~BATCH_BLOB)
+    {
+    case ExecAdd:
+        if (command & BATCH_BLOB)
+            store.put_blob(key, blob);
+        else
+            store.put(key, num);
+        return true;
+    case ExecDel:
+        store.erase(key);
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+NodeStorage::~NodeStorage()
+{
+    commit();
+    if (snapshot_thread_.joinable())
+        snapshot_thread_.join();
+    if (fd_ != -1)
+        close(fd_);
+}
+
+std::string NodeStorage::segment_path(uint64_t seq) const
+{
+    return prefix_ + ".wal." + std::to_string(seq);
+}
+
+bool NodeStorage::open_segment(uint64_t seq)
+{
+    int fd = ::open(segment_path(seq).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+    if (fd == -1)
+        return false;
+    if (fd_ != -1)
+        close(fd_);
+    fd_ = fd;
+    seq_ = seq;
+    sync_dir(dir_);
+    return true;
+}
+
+bool NodeStorage::load_snapshot(KvStore& store, uint64_t& first_seq)
+{
+    first_seq = 0;
+    int fd = ::open((prefix_ + ".snap").c_str(), O_RDONLY);
+    if (fd == -1)
+        return errno == ENOENT;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(SnapshotHeader))
+    {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    const SnapshotHeader* header = (const SnapshotHeader*)map;
+    const char* pos = (const char*)map + sizeof(SnapshotHeader);
+    const char* end = pos + header->payload_size;
+    bool ok = std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0
+              && header->version == SNAPSHOT_VERSION
+              && header->payload_size == (uint64_t)st.st_size - sizeof(SnapshotHeader)
+              && fnv1a(pos, header->payload_size) == header->checksum;
+    if (ok)
+    {
+        uint8_t command;
+        int64_t num;
+        std::string_view key, blob;
+        while (batch_next(pos, end, command, num, key, blob))
+            apply_record(store, command, num, key, blob);
+        first_seq = header->wal_seq;
+        snapshot_bytes_ = st.st_size;
+    }
+    munmap(map, st.st_size);
+    return ok;
+}
+
+bool NodeStorage::replay_segment(uint64_t seq, KvStore& store, bool last)
+{
+    std::string path = segment_path(seq);
+    int fd = ::open(path.c_str(), O_RDWR);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    const char* data = nullptr;
+    void* map = nullptr;
+    if (size > 0)
+    {
+        map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+        data = (const char*)map;
+    }
+    size_t offset = 0;
+    while (offset + 8 <= size)
+    {
+        uint32_t record_size, checksum;
+        std::memcpy(&record_size, data + offset, 4);
+        std::memcpy(&checksum, data + offset + 4, 4);
+        if (offset + 8 + record_size > size || fnv1a(data + offset + 8, record_size) != checksum)
+            break;
+        const char* pos = data + offset + 8;
+        uint8_t command;
+        int64_t num;
+        std::string_view key, blob;
+        if (batch_next(pos, pos + record_size, command, num, key, blob))
+            apply_record(store, command, num, key, blob);
+        offset += 8 + record_size;
+    }
+    if (map)
+        munmap(map, size);
+    // Оборванная запись бывает только в конце последнего сегмента
+    if (offset < size && last)
+        ftruncate(fd, offset);
+    close(fd);
+    wal_bytes_ += offset;
+    return offset == size || last;
+}
+
+bool NodeStorage::open(const std::string& dir, int id, KvStore& store, const std::string& part)
+{
+    dir_ = dir;
+    std::string name = "node-" + std::to_string(id) + part;
+    prefix_ = dir + "/" + name;
+    mkdir(dir.c_str(), 0777);
+    uint64_t first_seq;
+    if (!load_snapshot(store, first_seq))
+    {
+        std::cerr << "Node " << id << ": damaged snapshot " << prefix_ << ".snap" << std::endl;
+        return false;
+    }
+    // Сегменты журнала этого узла, начиная с first_seq
+    std::string name_prefix = name + ".wal.";
+    std::vector<uint64_t> segments;
+    if (DIR* d = opendir(dir.c_str()))
+    {
+        while (dirent* entry = readdir(d))
+        {
+            std::string name = entry->d_name;
+            if (name.compare(0, name_prefix.size(), name_prefix) != 0)
+                continue;
+            uint64_t seq = strtoull(name.c_str() + name_prefix.size(), nullptr, 10);
+            if (seq >= first_seq)
+                segments.push_back(seq);
+            else
+                unlink((dir + "/" + name).c_str()); // уже в снимке
+        }
+        closedir(d);
+    }
+    std::sort(segments.begin(), segments.end());
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        if (!replay_segment(segments[i], store, i + 1 == segments.size()))
+        {
+            std::cerr << "Node " << id << ": damaged log " << segment_path(segments[i]) << std::endl;
+            return false;
+        }
+    }
+    // Дописываем в последний сегмент (хвост уже обрезан до целой записи)
+    return open_segment(segments.empty() ? first_seq : segments.back());
+}
+
+std::vector<size_t> NodeStorage::stored_parts(const std::string& dir, int id)
+{
+    // node-<id>.wal.N, node-<id>.snap — одна часть; node-<id>.<i>of<n>.* — n частей
+    std::string name_prefix = "node-" + std::to_string(id) + ".";
+    std::vector<size_t> parts;
+    if (DIR* d = opendir(dir.c_str()))
+    {
+        while (dirent* entry = readdir(d))
+        {
+            std::string name = entry->d_name;
+            if (name.compare(0, name_prefix.size(), name_prefix) != 0)
+                continue;
+            const char* rest = name.c_str() + name_prefix.size();
+            size_t count = 1;
+            char* end;
+            strtoull(rest, &end, 10);
+            if (end != rest && std::strncmp(end, "of", 2) == 0)
+                count = strtoull(end + 2, nullptr, 10);
+            if (std::find(parts.begin(), parts.end(), count) == parts.end())
+                parts.push_back(count);
+        }
+        closedir(d);
+    }
+    std::sort(parts.begin(), parts.end());
+    return parts;
+}
+
+void NodeStorage::append_record(uint8_t command, int64_t num, std::string_view key, std::string_view blob)
+{
+    size_t start = buffer_.size();
+    buffer_.append(8, '\0');
+    batch_append(buffer_, command, num, key, blob);
+    uint32_t size = buffer_.size() - start - 8;
+    uint32_t checksum = fnv1a(buffer_.data() + start + 8, size);
+    std::memcpy(&buffer_[start], &size, 4);
+    std::memcpy(&buffer_[start + 4], &checksum, 4);
+}
+
+void NodeStorage::log_put(std::string_view key, int64_t number)
+{
+    append_record(ExecAdd, number, key, {});
+}
+
+void NodeStorage::log_put_blob(std::string_view key, std::string_view blob)
+{
+    append_record(ExecAdd | BATCH_BLOB, 0, key, blob);
+}
+
+void NodeStorage::log_erase(std::string_view key)
+{
+    append_record(ExecDel, 0, key, {});
+}
+
+bool NodeStorage::commit()
+{
+    if (buffer_.empty() || fd_ == -1)
+        return true;
+    // Изменения уже в словаре: при ошибке они не теряются, а остаются в буфере и
+    // уходят со следующей фиксацией. Частично записанное отрезается, иначе
+    // повтор лёг бы за оборванной записью и журнал читался бы только до неё
+    off_t committed = lseek(fd_, 0, SEEK_END);
+    if (!write_all(fd_, buffer_.data(), buffer_.size()) || fdatasync(fd_) != 0)
+    {
+        if (committed != -1)
+            ftruncate(fd_, committed);
+        return false;
+    }
+    wal_bytes_ += buffer_.size();
+    buffer_.clear();
+    return true;
+}
+
+void NodeStorage::maybe_snapshot(const KvStore& store)
+{
+    if (snapshot_running_.load() || wal_bytes_ < SNAPSHOT_MIN_WAL || wal_bytes_ < snapshot_bytes_)
+        return;
+    if (snapshot_thread_.joinable())
+        snapshot_thread_.join();
+    // Копия данных снимается здесь (последовательный проход по таблице), а запись
+    // и fsync идут в фоне. Новые изменения уже пишутся в следующий сегмент.
+    commit();
+    std::string image(sizeof(SnapshotHeader), '\0');
+    store.for_each([&](const KvStore::Entry& entry) {
+        if (entry.value.is_blob)
+            batch_append(image, ExecAdd | BATCH_BLOB, 0, entry.key, entry.value.blob);
+        else
+            batch_append(image, ExecAdd, entry.value.number, entry.key);
+    });
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.wal_seq = seq_ + 1;
+    header.count = store.size();
+    header.payload_size = image.size() - sizeof(SnapshotHeader);
+    header.checksum = fnv1a(image.data() + sizeof(SnapshotHeader), header.payload_size);
+    std::memcpy(&image[0], &header, sizeof(header));
+    if (!open_segment(seq_ + 1))
+        return;
+    snapshot_bytes_ = image.size();
+    wal_bytes_ = 0;
+    snapshot_running_.store(true);
+    snapshot_thread_ = std::thread(&NodeStorage::write_snapshot, this, std::move(image), seq_ - 1);
+}
+
+void NodeStorage::write_snapshot(std::string image, uint64_t covered_seq)
+{
+    std::string tmp = prefix_ + ".snap.tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    bool ok = fd != -1 && write_all(fd, image.data(), image.size()) && fdatasync(fd) == 0;
+    if (fd != -1)
+        close(fd);
+    if (ok && rename(tmp.c_str(), (prefix_ + ".snap").c_str()) == 0)
+    {
+        sync_dir(dir_);
+        // Сегменты до covered_seq включительно теперь в снимке
+        for (uint64_t seq = covered_seq + 1; seq-- > 0;)
+        {
+            if (unlink(segment_path(seq).c_str()) == -1)
+                break;
+        }
+    }
+    else
+        unlink(tmp.c_str());
+    snapshot_running_.store(false);
+}
@@ -0,0 +1,66 @@
+#ifndef PERSISTENCE_H
+#define PERSISTENCE_H
+
+#include "kv_store.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Долговечность хранилища узла (необязательная, включается каталогом данных).
+//
+// Журнал предзаписи: сегменты node-<id><part>.wal.<N>, записи
+//   размер (u32) | контрольная сумма FNV-1a (u32) | запись пакета (wire.h)
+// Изменения копятся в буфере и пишутся одним write + fdatasync за итерацию
+// цикла событий (групповая фиксация); ответы на них отправляются после фиксации.
+//
+// Снимок node-<id><part>.snap: заголовок SnapshotHeader и записи пакета со всеми
+// ключами. Его пишет фоновый поток из копии, снятой в основном потоке, затем
+// переименовывает поверх старого и удаляет покрытые сегменты журнала.
+// При запуске снимок отображается mmap и разбирается на месте, после чего
+// воспроизводится только хвост журнала; оборванная последняя запись отрезается.
+class NodeStorage {
+public:
+    ~NodeStorage();
+
+    // Восстанавливает store из каталога и открывает журнал для дозаписи;
+    // part отличает части словаря узла с несколькими обработчиками
+    bool open(const std::string& dir, int id, KvStore& store, const std::string& part = "");
+    // Сколько частей было у узла id в прежних файлах каталога (по их именам):
+    // пусто — файлов нет, несколько значений — остатки разных запусков
+    static std::vector<size_t> stored_parts(const std::string& dir, int id);
+
+    void log_put(std::string_view key, int64_t number);
+    void log_put_blob(std::string_view key, std::string_view blob);
+    void log_erase(std::string_view key);
+
+    // Есть ли изменения, ещё не записанные на диск
+    bool dirty() const { return !buffer_.empty(); }
+    // write + fdatasync накопленного; false — ошибка записи, накопленное
+    // сохраняется и повторяется следующим вызовом
+    bool commit();
+    // Снимок в фоне, если журнал с прошлого снимка вырос достаточно
+    void maybe_snapshot(const KvStore& store);
+
+private:
+    void append_record(uint8_t command, int64_t num, std::string_view key, std::string_view blob);
+    std::string segment_path(uint64_t seq) const;
+    bool open_segment(uint64_t seq);
+    bool replay_segment(uint64_t seq, KvStore& store, bool last);
+    bool load_snapshot(KvStore& store, uint64_t& first_seq);
+    void write_snapshot(std::string image, uint64_t covered_seq);
+
+    std::string dir_;
+    std::string prefix_; // dir/node-<id>
+    int fd_ = -1;
+    uint64_t seq_ = 0;           // текущий сегмент журнала
+    uint64_t wal_bytes_ = 0;     // записано в журнал с прошлого снимка
+    uint64_t snapshot_bytes_ = 0;
+    std::string buffer_;
+    std::thread snapshot_thread_;
+    std::atomic<bool> snapshot_running_{false};
+};
+
+#endif // PERSISTENCE_H
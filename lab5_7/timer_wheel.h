@@ -0,0 +1,89 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Колесо таймеров: срок округляется вверх до такта и попадает в ячейку
+// такт % число_ячеек. Добавление — O(1), отмена ленивая (владелец проверяет при
+// срабатывании, актуальна ли запись), срабатывание просматривает только
+// прошедшие такты. Сроки дальше одного оборота остаются в ячейке до своего круга.
+template <typename T>
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TimerWheel(std::chrono::milliseconds tick, size_t slots)
+        : tick_(tick), slots_(slots), origin_(Clock::now()) {}
+
+    void schedule(Clock::time_point deadline, T value) {
+        int64_t t = tick_of(deadline, true);
+        if (t < current_)
+            t = current_;
+        slots_[t % slots_.size()].push_back({deadline, value});
+        ++size_;
+    }
+
+    // Вызывает f(value) для всех записей со сроком не позже now
+    template <typename F>
+    void expire(Clock::time_point now, F f) {
+        int64_t now_tick = tick_of(now, false);
+        int64_t last = now_tick;
+        if (last - current_ >= (int64_t)slots_.size())
+            last = current_ + slots_.size() - 1;
+        for (int64_t t = current_; t <= last && size_ > 0; ++t) {
+            std::vector<Entry>& slot = slots_[t % slots_.size()];
+            size_t kept = 0;
+            for (size_t i = 0; i < slot.size(); ++i) {
+                if (slot[i].deadline <= now) {
+                    --size_;
+                    f(slot[i].value);
+                } else {
+                    slot[kept++] = slot[i];
+                }
+            }
+            slot.resize(kept);
+        }
+        // Текущий такт ещё не закончился: его ячейка проверяется и в следующий раз
+        current_ = now_tick;
+    }
+
+    // Сколько миллисекунд до ближайшей непустой ячейки (-1 — таймеров нет)
+    long msUntilNext(Clock::time_point now) const {
+        if (size_ == 0)
+            return -1;
+        for (int64_t t = current_; t < current_ + (int64_t)slots_.size(); ++t) {
+            if (!slots_[t % slots_.size()].empty()) {
+                auto at = origin_ + tick_ * t;
+                long left = (long)std::chrono::duration_cast<std::chrono::milliseconds>(at - now).count();
+                return left > 0 ? left : 0;
+            }
+        }
+        return 0;
+    }
+
+    size_t size() const { return size_; }
+
+private:
+    struct Entry {
+        Clock::time_point deadline;
+        T value;
+    };
+
+    int64_t tick_of(Clock::time_point at, bool round_up) const {
+        auto elapsed = at - origin_;
+        int64_t t = elapsed / tick_;
+        if (round_up && origin_ + tick_ * t < at)
+            ++t;
+        return t;
+    }
+
+    std::chrono::milliseconds tick_;
+    std::vector<std::vector<Entry>> slots_;
+    Clock::time_point origin_;
+    int64_t current_ = 0;
+    size_t size_ = 0;
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,207 @@
+#include "wire.h"
+#include <cstring>
+
+size_t put_varint(char* out, uint64_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        out[n++] = (char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (char)value;
+    return n;
+}
+
+bool get_varint(const char*& pos, const char* end, uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 70 && pos < end; shift += 7)
+    {
+        uint8_t byte = (uint8_t)*pos++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static size_t varint_size(uint64_t value)
+{
+    size_t n = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+static size_t field_size(std::string_view field)
+{
+    return field.empty() ? 0 : 1 + varint_size(field.size()) + field.size();
+}
+
+size_t wire_size(const MessageView& m)
+{
+    size_t size = 4 + varint_size(zigzag_encode(m.id)) + varint_size(zigzag_encode(m.num)) + field_size(m.key);
+    if (m.corr)
+        size += 2 + varint_size(m.corr);
+    if (!(m.flags & WIRE_MORE))
+        size += field_size(m.value);
+    if (m.flags & WIRE_TRACE)
+        size += field_size(m.trace);
+    return size;
+}
+
+static size_t put_field(char* out, uint8_t tag, std::string_view field)
+{
+    if (field.empty())
+        return 0;
+    size_t n = 0;
+    out[n++] = (char)tag;
+    n += put_varint(out + n, field.size());
+    std::memcpy(out + n, field.data(), field.size());
+    return n + field.size();
+}
+
+size_t wire_encode(const MessageView& m, char* out)
+{
+    size_t n = 0;
+    out[n++] = (char)WIRE_MAGIC;
+    out[n++] = (char)WIRE_VERSION;
+    out[n++] = (char)m.command;
+    out[n++] = (char)m.flags;
+    n += put_varint(out + n, zigzag_encode(m.id));
+    n += put_varint(out + n, zigzag_encode(m.num));
+    if (m.corr)
+    {
+        out[n++] = (char)TAG_CORR;
+        out[n++] = (char)varint_size(m.corr);
+        n += put_varint(out + n, m.corr);
+    }
+    n += put_field(out + n, TAG_KEY, m.key);
+    if (!(m.flags & WIRE_MORE))
+        n += put_field(out + n, TAG_VALUE, m.value);
+    if (m.flags & WIRE_TRACE)
+        n += put_field(out + n, TAG_TRACE, m.trace);
+    return n;
+}
+
+bool wire_decode(const char* data, size_t size, MessageView& m)
+{
+    if (size < 4 || (uint8_t)data[0] != WIRE_MAGIC || (uint8_t)data[1] != WIRE_VERSION)
+        return false;
+    m.command = (uint8_t)data[2];
+    m.flags = (uint8_t)data[3];
+    m.key = m.value = m.trace = std::string_view();
+    m.corr = 0;
+    const char* pos = data + 4;
+    const char* end = data + size;
+    uint64_t value;
+    if (!get_varint(pos, end, value))
+        return false;
+    m.id = zigzag_decode(value);
+    if (!get_varint(pos, end, value))
+        return false;
+    m.num = zigzag_decode(value);
+    while (pos < end)
+    {
+        uint8_t tag = (uint8_t)*pos++;
+        uint64_t length;
+        if (!get_varint(pos, end, length) || length > (uint64_t)(end - pos))
+            return false;
+        std::string_view field(pos, length);
+        if (tag == TAG_KEY)
+            m.key = field;
+        else if (tag == TAG_VALUE)
+            m.value = field;
+        else if (tag == TAG_TRACE)
+            m.trace = field;
+        else if (tag == TAG_CORR)
+        {
+            const char* corr_pos = pos;
+            if (!get_varint(corr_pos, pos + length, m.corr))
+                return false;
+        }
+        pos += length;
+    }
+    return true;
+}
+
+void batch_append(std::string& ops, uint8_t command, int64_t num, std::string_view key, std::string_view blob)
+{
+    char header[1 + 10 + 10];
+    size_t n = 0;
+    header[n++] = (char)command;
+    n += put_varint(header + n, zigzag_encode(num));
+    n += put_varint(header + n, key.size());
+    ops.append(header, n);
+    ops.append(key.data(), key.size());
+    if (command & BATCH_BLOB)
+    {
+        n = put_varint(header, blob.size());
+        ops.append(header, n);
+        ops.append(blob.data(), blob.size());
+    }
+}
+
+static bool get_string(const char*& pos, const char* end, std::string_view& out)
+{
+    uint64_t length;
+    if (!get_varint(pos, end, length) || length > (uint64_t)(end - pos))
+        return false;
+    out = std::string_view(pos, length);
+    pos += length;
+    return true;
+}
+
+bool batch_next(const char*& pos, const char* end, uint8_t& command, int64_t& num, std::string_view& key,
+                std::string_view& blob)
+{
+    if (pos >= end)
+        return false;
+    command = (uint8_t)*pos++;
+    uint64_t value;
+    if (!get_varint(pos, end, value) || !get_string(pos, end, key))
+        return false;
+    num = zigzag_decode(value);
+    blob = std::string_view();
+    return !(command & BATCH_BLOB) || get_string(pos, end, blob);
+}
+
+void beats_append(std::string& out, int64_t& prev_id, int64_t id, uint64_t age_us)
+{
+    char record[20];
+    size_t n = put_varint(record, zigzag_encode(id - prev_id));
+    n += put_varint(record + n, age_us);
+    out.append(record, n);
+    prev_id = id;
+}
+
+bool beats_next(const char*& pos, const char* end, int64_t& prev_id, int64_t& id, uint64_t& age_us)
+{
+    uint64_t delta;
+    if (pos >= end || !get_varint(pos, end, delta) || !get_varint(pos, end, age_us))
+        return false;
+    id = prev_id + zigzag_decode(delta);
+    prev_id = id;
+    return true;
+}
+
+void trace_append(std::string& trace, int64_t id, uint64_t time_us)
+{
+    char record[20];
+    size_t n = put_varint(record, zigzag_encode(id));
+    n += put_varint(record + n, time_us);
+    trace.append(record, n);
+}
+
+bool trace_next(const char*& pos, const char* end, int64_t& id, uint64_t& time_us)
+{
+    uint64_t encoded;
+    if (pos >= end || !get_varint(pos, end, encoded) || !get_varint(pos, end, time_us))
+        return false;
+    id = zigzag_decode(encoded);
+    return true;
+}
@@ -0,0 +1,103 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Двоичный формат сообщений между узлами (версия 1):
+//
+//   magic (1 байт, 0x57) | version (1) | command (1) | flags (1)
+//   id  — varint (zigzag)
+//   num — varint (zigzag)
+//   поля TLV до конца кадра: tag (1) | длина (varint) | байты
+//
+// Поле TAG_CORR (varint внутри TLV) — идентификатор запроса: ответ несёт тот же
+// идентификатор, поэтому к одному узлу может идти много запросов одновременно.
+// Пакет операций (команда Batch) хранит в значении последовательность
+// записей command (1) | num (zigzag varint) | длина ключа (varint) | ключ,
+// а если в command стоит бит BATCH_BLOB — ещё длина (varint) и байты блоба;
+// ответ на пакет — такие же записи с результатами и пустыми ключами.
+// Сводка heartbeat (команда HeartBeat снизу вверх) — записи узлов поддерева
+// по возрастанию id: разность с предыдущим id (zigzag varint) | возраст
+// последнего heartbeat узла в микросекундах (varint), 2–4 байта на узел.
+// Флаг WIRE_BLOB: значение записи — блоб из поля TAG_VALUE, а не num.
+// Флаг WIRE_TRACE: запрос трассируется — каждый узел на пути туда и обратно
+// дописывает в поле TAG_TRACE запись id (zigzag varint) | время steady_clock
+// в микросекундах (varint). Без флага поле не передаётся и не разбирается.
+//
+// Порядок байт не зависит от компилятора и платформы, ключи и значения любой
+// длины. Неизвестные поля пропускаются, поэтому новые теги не ломают старые узлы.
+// Флаг WIRE_MORE означает, что значение идёт следующим кадром ZeroMQ (большие
+// значения не копируются в кадр заголовка). Разбор не копирует данные: поля
+// MessageView указывают прямо в буфер кадра.
+
+const uint8_t WIRE_MAGIC = 0x57;
+const uint8_t WIRE_VERSION = 1;
+
+enum WireFlags : uint8_t {
+    WIRE_MORE = 1 << 0, // значение передаётся следующим кадром
+    WIRE_BLOB = 1 << 1, // значение — блоб в поле TAG_VALUE
+    WIRE_TRACE = 1 << 2 // в поле TAG_TRACE копятся отметки узлов на пути
+};
+
+const uint8_t BATCH_BLOB = 0x80; // бит команды записи пакета: за ключом следует блоб
+
+enum WireTag : uint8_t {
+    TAG_KEY = 1,
+    TAG_VALUE = 2,
+    TAG_CORR = 3,
+    TAG_TRACE = 4
+};
+
+// Максимальный размер заголовка без TLV-полей: 4 байта + два varint по 10 байт
+const size_t WIRE_HEADER_MAX = 24;
+
+struct MessageView {
+    uint8_t command = 0;
+    uint8_t flags = 0;
+    int64_t id = 0;
+    int64_t num = 0;
+    uint64_t corr = 0; // 0 — без идентификатора запроса
+    std::string_view key;
+    std::string_view value;
+    std::string_view trace;
+};
+
+inline uint64_t zigzag_encode(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t zigzag_decode(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Возвращает число записанных байт (не больше 10)
+size_t put_varint(char* out, uint64_t value);
+// Возвращает false, если varint обрывается или длиннее 10 байт
+bool get_varint(const char*& pos, const char* end, uint64_t& value);
+
+// Размер закодированного сообщения
+size_t wire_size(const MessageView& m);
+// Кодирует в out (не меньше wire_size байт), возвращает число записанных байт
+size_t wire_encode(const MessageView& m, char* out);
+// Разбирает кадр на месте; false — не наш формат, другая версия или обрыв
+bool wire_decode(const char* data, size_t size, MessageView& m);
+
+// Запись пакета операций; blob пишется, только если в command стоит BATCH_BLOB
+void batch_append(std::string& ops, uint8_t command, int64_t num, std::string_view key,
+                  std::string_view blob = {});
+// Очередная запись пакета; false — конец или обрыв
+bool batch_next(const char*& pos, const char* end, uint8_t& command, int64_t& num, std::string_view& key,
+                std::string_view& blob);
+
+// Запись сводки heartbeat; prev_id — id предыдущей записи (в начале 0)
+void beats_append(std::string& out, int64_t& prev_id, int64_t id, uint64_t age_us);
+bool beats_next(const char*& pos, const char* end, int64_t& prev_id, int64_t& id, uint64_t& age_us);
+
+// Отметка узла id в трассе запроса
+void trace_append(std::string& trace, int64_t id, uint64_t time_us);
+bool trace_next(const char*& pos, const char* end, int64_t& id, uint64_t& time_us);
+
+#endif // WIRE_H
@@ -0,0 +1,270 @@
+#include "worker_pool.h"
+#include "cluster.h"
+#include <functional>
+
+OpResult applyOp(KvStore& store, NodeStorage* storage, uint8_t command, int64_t num, std::string_view key,
+                 bool is_blob, std::string_view blob)
+{
+    OpResult result;
+    switch (command)
+    {
+    case ExecAdd:
+        if (is_blob)
+            store.put_blob(key, blob);
+        else
+            store.put(key, num);
+        if (storage)
+            is_blob ? storage->log_put_blob(key, blob) : storage->log_put(key, num);
+        result.command = ExecAdd;
+        break;
+    case ExecFnd:
+    {
+        KvStore::Value value;
+        if (store.get(key, value))
+        {
+            result.command = ExecFnd;
+            result.num = value.number;
+            result.is_blob = value.is_blob;
+            result.blob = value.blob;
+        }
+        else
+        {
+            result.command = ExecErr;
+            result.num = -1;
+        }
+        break;
+    }
+    case ExecMerge:
+    {
+        // Последняя запись побеждает: хранимое значение заменяется только более новым
+        KvStore::Value current;
+        VersionedValue stored, incoming;
+        result.command = ExecMerge;
+        if (!decodeVersioned(blob, incoming))
+        {
+            result.command = ExecErr;
+            result.num = -1;
+            break;
+        }
+        if (store.get(key, current) && current.is_blob && decodeVersioned(current.blob, stored)
+            && stored.version >= incoming.version)
+            break;
+        store.put_blob(key, blob);
+        if (storage)
+            storage->log_put_blob(key, blob);
+        result.num = 1;
+        break;
+    }
+    case ExecDel:
+        result.command = ExecDel;
+        result.num = store.erase(key) ? 1 : 0;
+        if (storage && result.num)
+            storage->log_erase(key);
+        break;
+    default:
+        result.command = ExecErr;
+        result.num = -1;
+        break;
+    }
+    return result;
+}
+
+WorkerPool::~WorkerPool()
+{
+    // Пустой указатель — сигнал обработчику завершиться
+    Job* stop = nullptr;
+    for (size_t i = 0; i < sends_.size(); ++i)
+    {
+        zmq_send(sends_[i], &stop, sizeof(stop), 0);
+        shards_[i]->thread.join();
+        zmq_close(sends_[i]);
+    }
+    if (done_)
+        zmq_close(done_);
+}
+
+bool WorkerPool::start(int node_id, size_t workers, const std::string& dir)
+{
+    size_t count = workers > 0 ? workers : 1;
+    // Части словаря привязаны к числу обработчиков: с другим числом прежние
+    // файлы не были бы прочитаны, и записанное молча пропало бы
+    if (!dir.empty())
+    {
+        for (size_t parts : NodeStorage::stored_parts(dir, node_id))
+        {
+            if (parts != count)
+            {
+                std::cerr << "Node " << node_id << ": " << dir << " was written with " << parts
+                          << " workers, started with " << count << "; use --workers " << parts << std::endl;
+                return false;
+            }
+        }
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto shard = std::make_unique<Shard>();
+        if (!dir.empty())
+        {
+            // Один обработчик пишет в прежние файлы узла; у частей — свои, поэтому
+            // каталог данных привязан к числу обработчиков
+            std::string part = count > 1 ? "." + std::to_string(i) + "of" + std::to_string(count) : "";
+            shard->storage = std::make_unique<NodeStorage>();
+            if (!shard->storage->open(dir, node_id, shard->store, part))
+                return false;
+            shard->keys.store(shard->store.size());
+        }
+        shards_.push_back(std::move(shard));
+    }
+    if (workers == 0)
+        return true;
+
+    // Сокеты обработчиков создаются и привязываются здесь, до запуска потоков:
+    // к моменту connect точка inproc уже существует. Очереди без ограничения
+    // длины: отправка задания не должна останавливать поток ввода-вывода
+    std::string prefix = "inproc://lab5_7-" + std::to_string(node_id) + "-work-";
+    done_endpoint_ = prefix + "done";
+    int unlimited = 0;
+    done_ = zmq_socket(sharedContext(), ZMQ_PULL);
+    zmq_setsockopt(done_, ZMQ_RCVHWM, &unlimited, sizeof(unlimited));
+    zmq_bind(done_, done_endpoint_.c_str());
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::string endpoint = prefix + std::to_string(i);
+        Shard& shard = *shards_[i];
+        shard.queue = zmq_socket(sharedContext(), ZMQ_PULL);
+        zmq_setsockopt(shard.queue, ZMQ_RCVHWM, &unlimited, sizeof(unlimited));
+        zmq_bind(shard.queue, endpoint.c_str());
+        void* send = zmq_socket(sharedContext(), ZMQ_PUSH);
+        zmq_setsockopt(send, ZMQ_SNDHWM, &unlimited, sizeof(unlimited));
+        zmq_connect(send, endpoint.c_str());
+        sends_.push_back(send);
+        shard.thread = std::thread(&WorkerPool::run, this, std::ref(shard));
+    }
+    return true;
+}
+
+size_t WorkerPool::shard_of(std::string_view key) const
+{
+    return std::hash<std::string_view>()(key) % shards_.size();
+}
+
+size_t WorkerPool::keys() const
+{
+    size_t total = 0;
+    for (const auto& shard : shards_)
+        total += shard->keys.load(std::memory_order_relaxed);
+    return total;
+}
+
+void WorkerPool::submit(Job* job)
+{
+    ++in_flight_;
+    if (sends_.empty())
+    {
+        process(*shards_[job->shard], *job);
+        finished_.push_back(job);
+        return;
+    }
+    zmq_send(sends_[job->shard], &job, sizeof(job), 0);
+}
+
+void WorkerPool::flush()
+{
+    if (!sends_.empty() || finished_.empty())
+        return;
+    Shard& shard = *shards_[0];
+    bool ok = !shard.storage || shard.storage->commit();
+    for (Job* job : finished_)
+    {
+        job->failed = !ok;
+        ready_.push_back(job);
+    }
+    finished_.clear();
+    if (shard.storage)
+        shard.storage->maybe_snapshot(shard.store);
+}
+
+Job* WorkerPool::take()
+{
+    if (sends_.empty())
+    {
+        if (ready_.empty())
+            return nullptr;
+        Job* job = ready_.front();
+        ready_.pop_front();
+        --in_flight_;
+        return job;
+    }
+    Job* job;
+    if (zmq_recv(done_, &job, sizeof(job), ZMQ_DONTWAIT) != sizeof(job))
+        return nullptr;
+    --in_flight_;
+    return job;
+}
+
+void WorkerPool::process(Shard& shard, Job& job)
+{
+    if (job.kind == Job::Ops)
+    {
+        const char* pos = job.ops.data();
+        const char* end = pos + job.ops.size();
+        uint8_t command;
+        int64_t num;
+        std::string_view key, blob;
+        while (batch_next(pos, end, command, num, key, blob))
+        {
+            OpResult result = applyOp(shard.store, shard.storage.get(), command & ~BATCH_BLOB, num, key,
+                                      command & BATCH_BLOB, blob);
+            batch_append(job.results, result.command | (result.is_blob ? BATCH_BLOB : 0), result.num, {},
+                         result.blob);
+        }
+        shard.keys.store(shard.store.size(), std::memory_order_relaxed);
+        return;
+    }
+    // Ключи копируются в результаты сразу: ссылки в таблицу обработчика
+    // недействительны за пределами его потока
+    std::vector<KvStore::Entry> entries = job.kind == Job::Scan ? shard.store.scan_prefix(job.key, job.limit)
+                                                                : shard.store.scan_range(job.key, job.to, job.limit);
+    for (const KvStore::Entry& entry : entries)
+        batch_append(job.results, entry.value.is_blob ? ExecFnd | BATCH_BLOB : ExecFnd, entry.value.number,
+                     entry.key, entry.value.blob);
+}
+
+void WorkerPool::run(Shard& shard)
+{
+    void* done = zmq_socket(sharedContext(), ZMQ_PUSH);
+    int unlimited = 0;
+    zmq_setsockopt(done, ZMQ_SNDHWM, &unlimited, sizeof(unlimited));
+    zmq_connect(done, done_endpoint_.c_str());
+    std::vector<Job*> jobs;
+    bool stop = false;
+    while (!stop)
+    {
+        // Ждём задание, затем забираем всё, что успело накопиться
+        Job* job;
+        int flags = 0;
+        while (zmq_recv(shard.queue, &job, sizeof(job), flags) == sizeof(job))
+        {
+            if (!job)
+            {
+                stop = true;
+                break;
+            }
+            jobs.push_back(job);
+            flags = ZMQ_DONTWAIT;
+        }
+        for (Job* pending : jobs)
+            process(shard, *pending);
+        bool ok = !shard.storage || shard.storage->commit();
+        for (Job* pending : jobs)
+        {
+            pending->failed = !ok;
+            zmq_send(done, &pending, sizeof(pending), 0);
+        }
+        jobs.clear();
+        if (shard.storage)
+            shard.storage->maybe_snapshot(shard.store);
+    }
+    zmq_close(shard.queue);
+    zmq_close(done);
+}
@@ -0,0 +1,95 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "kv_store.h"
+#include "persistence.h"
+#include "lib.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Результат одной операции над хранилищем
+struct OpResult {
+    com command;
+    int64_t num = 0;
+    bool is_blob = false;
+    std::string_view blob;
+};
+
+// Изменения записываются в журнал storage (если он есть) вслед за применением
+OpResult applyOp(KvStore& store, NodeStorage* storage, uint8_t command, int64_t num, std::string_view key,
+                 bool is_blob, std::string_view blob);
+
+// Задание обработчику: операции над одной частью словаря. Передаётся по inproc
+// указателем, владеет им поток ввода-вывода; обработчик только заполняет результаты.
+struct Job {
+    enum Kind : uint8_t { Ops, Scan, Range };
+    Kind kind = Ops;
+    uint64_t request = 0; // номер запроса у потока ввода-вывода
+    size_t shard = 0;
+    std::string ops;      // записи пакета (wire.h), для Ops
+    std::string key, to;  // префикс или границы, для Scan / Range
+    int64_t limit = 0;
+    std::string results;  // записи пакета: по одной на операцию или найденный ключ
+    bool failed = false;  // журнал не записан, результатам верить нельзя
+};
+
+// Словарь узла, разделённый на части по хэшу ключа. Каждой частью владеет свой
+// поток-обработчик (с её журналом), поэтому части не делят блокировок, а поток
+// ввода-вывода маршрутизирует и отвечает на ping, пока обработчики заняты.
+// Задания уходят обработчикам через PUSH/PULL inproc и возвращаются через общий
+// PULL, который поток ввода-вывода опрашивает вместе с остальными сокетами.
+// Обработчик выполняет всё накопившееся, фиксирует журнал одним fdatasync и
+// только затем возвращает задания — групповая фиксация на каждый поток.
+// Без потоков (workers = 0) задания выполняются сразу в потоке ввода-вывода,
+// а фиксация — в flush() раз за итерацию цикла, как раньше.
+class WorkerPool {
+public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool();
+
+    // Восстанавливает части словаря из dir (если не пусто) и запускает потоки
+    bool start(int node_id, size_t workers, const std::string& dir);
+    size_t shards() const { return shards_.size(); }
+    size_t shard_of(std::string_view key) const;
+
+    void submit(Job* job);
+    // Сокет готовых заданий для zmq_poll; nullptr без потоков
+    void* done_socket() const { return done_; }
+    // Без потоков: фиксация журнала выполненных заданий (ошибка — в Job::failed)
+    void flush();
+    // Готовое задание или nullptr
+    Job* take();
+
+    // Для stats: заданий у обработчиков и ключей во всех частях словаря
+    size_t in_flight() const { return in_flight_; }
+    size_t keys() const;
+
+private:
+    struct Shard {
+        KvStore store;
+        std::unique_ptr<NodeStorage> storage;
+        void* queue = nullptr; // PULL обработчика; PUSH к нему — в sends_
+        std::thread thread;
+        std::atomic<size_t> keys{0}; // размер store, обновляет владелец части
+    };
+
+    static void process(Shard& shard, Job& job);
+    void run(Shard& shard);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<void*> sends_;
+    std::string done_endpoint_;
+    void* done_ = nullptr;
+    std::vector<Job*> finished_; // без потоков: выполнены, ждут flush
+    std::deque<Job*> ready_;     // без потоков: зафиксированы, в порядке выполнения
+    size_t in_flight_ = 0;
+};
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,34 @@
+#ifndef ZIPF_H
+#define ZIPF_H
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Номера ключей 0..n-1 по закону Ципфа: вероятность k-го пропорциональна
+// 1 / (k + 1)^s. Функция распределения считается один раз, выборка — двоичный поиск.
+class ZipfGenerator {
+public:
+    ZipfGenerator(size_t n, double s) : cdf_(n) {
+        double sum = 0;
+        for (size_t k = 0; k < n; ++k) {
+            sum += 1.0 / std::pow((double)(k + 1), s);
+            cdf_[k] = sum;
+        }
+        for (double& p : cdf_)
+            p /= sum;
+    }
+
+    template <typename Rng>
+    size_t operator()(Rng& rng) {
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        size_t k = std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin();
+        return std::min(k, cdf_.size() - 1);
+    }
+
+private:
+    std::vector<double> cdf_;
+};
+
+#endif // ZIPF_H